@@ -66,9 +66,10 @@ CBUSbase::CBUSbase(CBUSConfig &config) : m_numMsgsSent{0x0L},
                                          m_pModuleName{nullptr},
                                          eventHandler{nullptr},
                                          eventHandlerEx{nullptr},
-                                         frameHandler{nullptr},
-                                         m_opcodes{nullptr},
-                                         m_numOpcodes{0x0U},
+                                         eventHandlerEVs{nullptr},
+                                         m_frameHandlers{},
+                                         m_numFrameHandlers{0x0U},
+                                         m_frameOpcodes{},
                                          m_enumResponses{},
                                          m_bLearn{false},
                                          m_bThisNN{false},
@@ -82,8 +83,33 @@ CBUSbase::CBUSbase(CBUSConfig &config) : m_numMsgsSent{0x0L},
                                          m_prevFlimState{fsState::fsUnknown},
                                          longMessageHandler{nullptr},
                                          m_gcServer{nullptr},
-                                         m_coeObj{nullptr}
+                                         m_coeObj{nullptr},
+                                         m_pOpcodeTable{&getDefaultOpcodeTable()},
+                                         m_processBudget{0x0UL},
+                                         m_numBudgetExpiries{0x0UL},
+                                         m_frameCost{0x0UL},
+                                         m_bAdaptiveBatch{false},
+                                         m_rxHighWaterMark{0x0U},
+                                         m_rxWeights{},
+                                         m_rxStarvations{},
+                                         m_rxSource{0x0U},
+                                         m_rxServed{0x0U},
+                                         m_bEventDriven{false},
+                                         m_housekeepingInterval{HOUSEKEEPING_INTERVAL},
+                                         m_lastHousekeeping{0x0UL},
+                                         m_streamType{RESPONSE_STREAM::STREAM_NONE},
+                                         m_streamIndex{0x0U},
+                                         m_batchEvents{nullptr},
+                                         m_batchNumEvents{0x0U},
+                                         m_batchNext{0x0U},
+                                         m_batchCallback{nullptr},
+                                         m_numEventsReceived{0x0UL},
+                                         m_numEventsRejected{0x0UL}
 {
+   for (auto &weight : m_rxWeights)
+   {
+      weight = RX_SOURCE_DEFAULT_WEIGHT;
+   }
 }
 
 //
@@ -102,16 +128,97 @@ void CBUSbase::setEventHandlerExCB(eventExCallback_t evExCallback)
    eventHandlerEx = evExCallback;
 }
 
+// register a user event callback which receives the opcode on/off state and the event variables mirrored in RAM
+
+void CBUSbase::setEventHandlerEVsCB(eventEVsCallback_t evEVsCallback)
+{
+   eventHandlerEVs = evEVsCallback;
+}
+
 //
-/// register a user callback for CAN frames
+/// register a user callback for CAN frames, replacing any registered frame handlers
 /// default args in .h declaration for opcodes array (nullptr) and size (0)
 //
 
 void CBUSbase::setFrameHandler(frameCallback_t frameCallback, uint8_t opcodes[], uint8_t num_opcodes)
 {
-   frameHandler = frameCallback;
-   m_opcodes = opcodes;
-   m_numOpcodes = num_opcodes;
+   m_numFrameHandlers = 0;
+   m_frameOpcodes.reset();
+
+   if (frameCallback != nullptr)
+   {
+      addFrameHandler(frameCallback, makeOpcodeMask(opcodes, num_opcodes));
+   }
+}
+
+//
+/// register an additional user callback for CAN frames, called for each opcode set in the mask
+/// returns false if the maximum number of frame handlers are already registered
+//
+
+bool CBUSbase::addFrameHandler(frameCallback_t frameCallback, const opcodeMask_t &opcodes)
+{
+   if ((frameCallback == nullptr) || (m_numFrameHandlers >= MAX_FRAME_HANDLERS))
+   {
+      return false;
+   }
+
+   m_frameHandlers[m_numFrameHandlers++] = {frameCallback, opcodes};
+   m_frameOpcodes |= opcodes;
+
+   return true;
+}
+
+//
+/// remove a registered user callback for CAN frames
+/// returns false if the callback was not registered
+//
+
+bool CBUSbase::removeFrameHandler(frameCallback_t frameCallback)
+{
+   bool bRemoved = false;
+   uint8_t count = 0;
+
+   m_frameOpcodes.reset();
+
+   // compact the remaining handlers, preserving their registration order
+   for (uint_fast8_t i = 0; i < m_numFrameHandlers; i++)
+   {
+      if (m_frameHandlers[i].callback == frameCallback)
+      {
+         bRemoved = true;
+         continue;
+      }
+
+      m_frameHandlers[count++] = m_frameHandlers[i];
+      m_frameOpcodes |= m_frameHandlers[i].opcodes;
+   }
+
+   m_numFrameHandlers = count;
+
+   return bRemoved;
+}
+
+//
+/// build an opcode subscription mask from a list of opcodes
+/// an empty list subscribes to all opcodes
+//
+
+opcodeMask_t CBUSbase::makeOpcodeMask(const uint8_t *opcodes, uint8_t num_opcodes)
+{
+   opcodeMask_t mask;
+
+   if ((opcodes == nullptr) || (num_opcodes == 0))
+   {
+      return mask.set();
+   }
+
+   for (uint_fast8_t i = 0; i < num_opcodes; i++)
+   {
+      mask.set(opcodes[i]);
+   }
+
+   return mask;
 }
 
 //
@@ -423,6 +530,32 @@ bool CBUSbase::sendEvent(const uint16_t eventNode, const uint16_t eventNum, cons
 bool CBUSbase::sendEventWithData(uint16_t eventNode, const uint16_t eventNum, const bool onEvent, const uint8_t dataLen, const uint8_t d1, const uint8_t d2, const uint8_t d3)
 {
    CANFrame frame;
+   eventNode = makeEventFrame(frame, eventNode, eventNum, onEvent, dataLen, d1, d2, d3);
+
+   // If we're consuming our own events, post to rx queue
+   if (m_coeObj != nullptr)
+   {
+      m_coeObj->put(frame);
+   }
+
+   return sendMsgNN(frame, eventNode);
+};
+
+///
+/// @brief Build a CBUS event frame, without the node number
+///
+/// @param frame the frame to build
+/// @param eventNode the event node number, 0 for a short event
+/// @param eventNum the CBUS event node number
+/// @param onEvent if true build an ON event, otherwise an OFF event
+/// @param dataLen number of optional data bytes [0-3]
+/// @param d1 Optional first event data byte
+/// @param d2 Optional second event data byte
+/// @param d3 Optional third event data byte
+/// @return uint16_t the node number to send the event with
+///
+uint16_t CBUSbase::makeEventFrame(CANFrame &frame, uint16_t eventNode, const uint16_t eventNum, const bool onEvent, const uint8_t dataLen, const uint8_t d1, const uint8_t d2, const uint8_t d3)
+{
    frame.id = m_moduleConfig.getCANID();
    frame.len = 5 + dataLen;
    frame.data[0] = OPC_ACON; // Start with long event opcode
@@ -455,14 +588,93 @@ bool CBUSbase::sendEventWithData(uint16_t eventNode, const uint16_t eventNum, co
    frame.data[6] = d2;
    frame.data[7] = d3;
 
-   // If we're consuming our own events, post to rx queue
-   if (m_coeObj != nullptr)
+   return eventNode;
+}
+
+///
+/// @brief Send a batch of CBUS events back to back.  The events are sent as transmit
+/// capacity allows, continuing from process(), and the callback is called once all have
+/// been sent.  The array must remain valid until then
+///
+/// @param events array of events to send
+/// @param numEvents number of events in the array
+/// @param callback called when the last event has been sent, may be nullptr
+/// @return true the batch was accepted
+/// @return false a batch is already in progress
+///
+bool CBUSbase::sendEvents(const EVENT_SEND_t *events, const uint16_t numEvents, eventBatchCallback_t callback)
+{
+   if (eventBatchActive() || (events == nullptr))
    {
-      m_coeObj->put(frame);
+      return false;
    }
 
-   return sendMsgNN(frame, eventNode);
-};
+   m_batchEvents = events;
+   m_batchNumEvents = numEvents;
+   m_batchNext = 0;
+   m_batchCallback = callback;
+
+   // Start sending straight away
+   processEventBatch();
+
+   return true;
+}
+
+///
+/// @brief Send the next events of a batch until the transmit queue refuses a frame,
+/// the remaining events are sent on later calls to process()
+///
+void CBUSbase::processEventBatch(void)
+{
+   if (m_batchEvents == nullptr)
+   {
+      return;
+   }
+
+   while (m_batchNext < m_batchNumEvents)
+   {
+      const EVENT_SEND_t &event = m_batchEvents[m_batchNext];
+
+      CANFrame frame;
+      uint16_t eventNode = makeEventFrame(frame, event.nodeNumber, event.eventNumber, event.onEvent,
+                                          event.dataLen, event.data[0], event.data[1], event.data[2]);
+
+      // Set node number into the frame
+      frame.data[1] = highByte(eventNode);
+      frame.data[2] = lowByte(eventNode);
+
+      // sendMessage() writes the header, rtr and ext flags into the frame, so keep the
+      // frame as built for the consume own events queue
+      CANFrame coeFrame = frame;
+
+      if (!sendMessage(frame))
+      {
+         // Transmit queue full, resume from this event on the next call
+         return;
+      }
+
+      // If we're consuming our own events, post to rx queue once sent, so a
+      // retried event is only posted once
+      if (m_coeObj != nullptr)
+      {
+         m_coeObj->put(coeFrame);
+      }
+
+      m_batchNext++;
+   }
+
+   // Batch complete
+   const EVENT_SEND_t *events = m_batchEvents;
+   eventBatchCallback_t callback = m_batchCallback;
+
+   m_batchEvents = nullptr;
+   m_batchCallback = nullptr;
+
+   if (callback != nullptr)
+   {
+      callback(events, m_batchNumEvents);
+   }
+}
 
 ///
 /// @brief Send a debug message with 5 data bytes
@@ -572,160 +784,523 @@ void CBUSbase::indicateModeOnLEDs(uint8_t mode)
    }
 }
 
-void CBUSbase::indicateFLiMMode(bool bFLiM)
+void CBUSbase::indicateFLiMMode(bool bFLiM)
+{
+   // Set initial FLiM state from persistent storage
+   if (bFLiM)
+   {
+      m_flimState = fsState::fsFLiM;
+   }
+   else
+   {
+      m_flimState = fsState::fsSLiM;
+   }
+
+   indicateModeOnLEDs(bFLiM ? MODE_FLIM : MODE_SLIM);
+}
+
+//
+/// retrieve up to max messages from the transport, the default implementation
+/// pulls one frame at a time, derived classes with a receive queue should override this
+//
+
+uint8_t CBUSbase::getMessages(CANFrame *out, uint8_t max)
+{
+   uint8_t count = 0;
+
+   while ((count < max) && available())
+   {
+      out[count++] = getNextMessage();
+   }
+
+   return count;
+}
+
+//
+/// limit the time spent processing received frames in each call to process()
+/// frames are processed until the budget expires, each burst is sized from the measured
+/// cost of processing a frame, so the budget is exceeded by at most about one frame, 0 removes the limit
+//
+
+void CBUSbase::setProcessBudget(uint32_t budget_us)
+{
+   m_processBudget = budget_us;
+}
+
+//
+/// enable scaling of the number of frames processed per call with the receive queue depth
+//
+
+void CBUSbase::setAdaptiveBatch(bool bAdaptive)
+{
+   m_bAdaptiveBatch = bAdaptive;
+}
+
+//
+/// determine the number of frames to process in this call to process()
+/// when the receive queue is more than half full, or has reached a new peak since the
+/// previous call, the batch is extended by the queue depth so bursts drain before overflowing
+//
+
+uint8_t CBUSbase::getProcessBatch(uint8_t num_messages)
+{
+   CBUSCircularBuffer *rxQueue = getRxQueue();
+
+   if (!m_bAdaptiveBatch || (rxQueue == nullptr))
+   {
+      return num_messages;
+   }
+
+   uint8_t freeSlots = rxQueue->getNumFreeSlots();
+   uint8_t depth = rxQueue->size();
+   uint8_t highWaterMark = rxQueue->getHighWaterMark();
+
+   bool bPressure = (depth > freeSlots) || (highWaterMark > m_rxHighWaterMark);
+
+   m_rxHighWaterMark = highWaterMark;
+
+   if (bPressure)
+   {
+      uint32_t batch = num_messages + depth;
+      return (batch > UINT8_MAX) ? UINT8_MAX : batch;
+   }
+
+   return num_messages;
+}
+
+//
+/// main CBUS message processing procedure
+//
+void CBUSbase::process(uint8_t num_messages)
+{
+   //
+   // process FLiM UI, on every run when polled, or when the interval is due in event-driven mode
+   //
+
+   if (!m_bEventDriven || housekeepingDue())
+   {
+      m_lastHousekeeping = SystemTick::GetMilli();
+
+      // allow LEDs to update
+      m_ledGrn.run();
+      m_ledYlw.run();
+
+      // allow the CBUS switch some processing time
+      m_sw.run();
+
+      // Process FLiM switch and state machine
+      FLiMSWCheck();
+
+      // Process CAN ID self-enumeration
+      processEnumeration();
+   }
+
+   // Clear any wakeup before draining the sources, so frames queued from here on signal a new one
+   s_bWakeup = false;
+
+   // Resume any transmissions deferred by the transport
+   serviceTransmit();
+
+   // process received CAN frames a burst at a time
+   // process by default 3 messages per run so the user's application code doesn't appear unresponsive under load
+   // the limit may be raised by the receive queue depth, and the time spent bounded by a budget
+   // the sources are served in weighted round-robin order, continuing from the previous run
+
+   uint8_t limit = getProcessBatch(num_messages);
+   uint8_t mcount = 0;
+   uint8_t idle = 0;      // consecutive sources found with nothing to process
+   uint8_t served = 0;    // bitmap of sources that delivered frames in this run
+   bool bCutShort = false; // stopped by the limit or budget rather than running out of frames
+   uint32_t startTime = (m_processBudget > 0) ? SystemTick::GetMicros() : 0;
+   uint32_t burstTime = startTime;
+
+   while (idle < RX_NUM_SOURCES)
+   {
+      if (mcount >= limit)
+      {
+         // Limit messages processed per run
+         bCutShort = true;
+         break;
+      }
+
+      uint8_t nwanted = limit - mcount;
+
+      if (nwanted > PROCESS_BURST_LEN)
+      {
+         nwanted = PROCESS_BURST_LEN;
+      }
+
+      if (m_processBudget > 0)
+      {
+         uint32_t elapsed = burstTime - startTime;
+
+         if (elapsed >= m_processBudget)
+         {
+            // Time budget used up, leave remaining frames for the next run
+            m_numBudgetExpiries++;
+            bCutShort = true;
+            break;
+         }
+
+         // Size the burst to fit the remaining budget, a single frame until the cost is known
+         uint32_t nfit = (m_frameCost > 0) ? (m_processBudget - elapsed) / m_frameCost : 1;
+
+         if (nfit == 0)
+         {
+            nfit = 1;
+         }
+
+         if (nwanted > nfit)
+         {
+            nwanted = nfit;
+         }
+      }
+
+      // Limit the burst to the credit remaining for the current source in this round
+      uint8_t source = m_rxSource;
+      uint8_t credit = (m_rxServed < m_rxWeights[source]) ? (m_rxWeights[source] - m_rxServed) : 0;
+
+      if (nwanted > credit)
+      {
+         nwanted = credit;
+      }
+
+      uint8_t nframes = processSource(static_cast<RX_SOURCE>(source), nwanted);
+
+      m_rxServed += nframes;
+
+      // Move to the next source when this one has used its credit or has run dry
+      if ((nframes < nwanted) || (m_rxServed >= m_rxWeights[source]))
+      {
+         m_rxSource = (source + 1) % RX_NUM_SOURCES;
+         m_rxServed = 0;
+      }
+
+      if (nframes == 0)
+      {
+         // No message to process from this source
+         idle++;
+         continue;
+      }
+
+      idle = 0;
+      served |= (1 << source);
+      mcount += nframes;
+
+      if (m_processBudget > 0)
+      {
+         // Track a running average of the time taken to process a frame
+         uint32_t now = SystemTick::GetMicros();
+         uint32_t cost = (now - burstTime) / nframes;
+
+         m_frameCost = (m_frameCost > 0) ? (m_frameCost * 7 + cost) / 8 : cost;
+         burstTime = now;
+      }
+   } // while messages available
+
+   // Continue any multi-frame response and event batch
+   processStream();
+   processEventBatch();
+
+   if (bCutShort)
+   {
+      // Count the sources left waiting with frames that were not served in this run
+      for (uint_fast8_t source = 0; source < RX_NUM_SOURCES; source++)
+      {
+         if (!(served & (1 << source)) && sourceAvailable(static_cast<RX_SOURCE>(source)))
+         {
+            m_rxStarvations[source]++;
+         }
+      }
+   }
+
+   //
+   /// end of CBUS message processing
+   //
+}
+
+//
+/// select event-driven operation, housekeeping (LEDs, switch, FLiM state and CAN ID enumeration)
+/// runs every interval_ms rather than on each call to process(), so the application can sleep
+/// in waitForWork() between calls
+//
+
+void CBUSbase::setEventDriven(bool bEventDriven, uint32_t interval_ms)
+{
+   m_bEventDriven = bEventDriven;
+   m_housekeepingInterval = interval_ms;
+}
+
+//
+/// determine if the housekeeping interval has elapsed
+//
+
+bool CBUSbase::housekeepingDue(void)
+{
+   return (SystemTick::GetMilli() - m_lastHousekeeping) >= m_housekeepingInterval;
+}
+
+//
+/// determine if process() has work to do, always true unless event-driven
+//
+
+bool CBUSbase::workPending(void)
+{
+   if (!m_bEventDriven || s_bWakeup || housekeepingDue() || streamActive() || eventBatchActive())
+   {
+      return true;
+   }
+
+   for (uint_fast8_t source = 0; source < RX_NUM_SOURCES; source++)
+   {
+      if (sourceAvailable(static_cast<RX_SOURCE>(source)))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+//
+/// in event-driven mode, sleep until a wakeup is signalled, an interrupt occurs,
+/// the housekeeping interval is due, a deferred transmission may be sent, or max_wait_ms
+/// has elapsed, returns immediately if work is pending, or when not event-driven
+//
+
+void CBUSbase::waitForWork(uint32_t max_wait_ms)
+{
+   if (workPending())
+   {
+      return;
+   }
+
+   uint32_t elapsed = SystemTick::GetMilli() - m_lastHousekeeping;
+
+   // housekeeping may have fallen due since the check above, do not let the wait wrap
+   if (elapsed > m_housekeepingInterval)
+   {
+      elapsed = m_housekeepingInterval;
+   }
+
+   uint32_t wait = m_housekeepingInterval - elapsed;
+
+   if (wait > max_wait_ms)
+   {
+      wait = max_wait_ms;
+   }
+
+   // long waits overflow 32 bits in microseconds, so convert in 64 bits
+   uint64_t wait_us = static_cast<uint64_t>(wait) * 1000;
+   uint32_t tx_wait_us;
+
+   // frames held back by a transmit rate limit are sent by process() once a token is available
+   if (txPending(tx_wait_us) && (tx_wait_us < wait_us))
+   {
+      wait_us = tx_wait_us;
+   }
+
+   // a wakeup signalled since the check above has set the event flag, so WFE returns at once
+   SystemTick::WaitForEvent((wait_us > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(wait_us));
+}
+
+//
+/// signal that work is queued for process(), may be called from an interrupt handler or the other core
+//
+
+void CBUSbase::signalWakeup(void)
+{
+   s_bWakeup = true;
+   SystemTick::SignalEvent();
+}
+
+//
+/// determine if a receive source has frames waiting
+//
+
+bool CBUSbase::sourceAvailable(RX_SOURCE source)
+{
+   switch (source)
+   {
+   case RX_SOURCE::RX_SOURCE_COE:
+      return (m_coeObj != nullptr) && m_coeObj->available();
+
+   case RX_SOURCE::RX_SOURCE_GC:
+      return (m_gcServer != nullptr) && m_gcServer->available();
+
+   case RX_SOURCE::RX_SOURCE_CAN:
+      return available();
+
+   default:
+      return false;
+   }
+}
+
+//
+/// retrieve and dispatch up to nwanted frames from a single receive source
+/// returns the number of frames processed
+//
+
+uint8_t CBUSbase::processSource(RX_SOURCE source, uint8_t nwanted)
+{
+   uint8_t nframes = 0;
+
+   switch (source)
+   {
+   case RX_SOURCE::RX_SOURCE_COE:
+      // Check for messages on COE queue
+      if (m_coeObj != nullptr && (nframes = m_coeObj->getMessages(m_rxStage, nwanted)) > 0)
+      {
+         dispatchFrames(m_rxStage, nframes);
+      }
+      break;
+
+   case RX_SOURCE::RX_SOURCE_GC:
+      // Check for messages on GridConnect
+      if (m_gcServer != nullptr && (nframes = m_gcServer->getMessages(m_rxStage, nwanted)) > 0)
+      {
+         dispatchFrames(m_rxStage, nframes);
+      }
+      break;
+
+   case RX_SOURCE::RX_SOURCE_CAN:
+      // Check for messages on CAN
+      if (!available())
+      {
+         break;
+      }
+
+      // Check if we can forward on Grid Connect (if we have a GC server)
+      if (m_gcServer != nullptr)
+      {
+         // Pull a single frame at a time from the FIFO, as GC must accept each forwarded frame
+         // If we cannot send on GC, leave the frame in the CAN FIFO
+         while ((nframes < nwanted) && m_gcServer->canSend())
+         {
+            CANFrame msg;
+
+            if (getMessages(&msg, 1) == 0)
+            {
+               break;
+            }
+
+            nframes++;
+
+            // Forward on GridConnect, indicate if we have more data to send immediately
+            m_gcServer->sendCANFrame(msg, available());
+
+            dispatchFrame(msg);
+         }
+      }
+      else
+      {
+         // Unpack a burst of frames from the FIFO
+         nframes = getMessages(m_rxStage, nwanted);
+
+         dispatchFrames(m_rxStage, nframes);
+      }
+      break;
+
+   default:
+      break;
+   }
+
+   return nframes;
+}
+
+//
+/// set the number of frames a receive source may deliver in each round of the scheduler
+/// a weight of zero is treated as one, so no source can be starved indefinitely
+//
+
+void CBUSbase::setSourceWeight(RX_SOURCE source, uint8_t weight)
 {
-   // Set initial FLiM state from persistent storage
-   if (bFLiM)
-   {
-      m_flimState = fsState::fsFLiM;
-   }
-   else
+   if (source < RX_SOURCE::RX_NUM_SOURCES)
    {
-      m_flimState = fsState::fsSLiM;
-   }
+      m_rxWeights[static_cast<uint8_t>(source)] = (weight > 0) ? weight : 1;
 
-   indicateModeOnLEDs(bFLiM ? MODE_FLIM : MODE_SLIM);
+      // Restart the round of the current source, its credit may now be less than already served
+      if (static_cast<uint8_t>(source) == m_rxSource)
+      {
+         m_rxServed = 0;
+      }
+   }
 }
 
 //
-/// main CBUS message processing procedure
+/// get the number of frames a receive source may deliver in each round of the scheduler
 //
-void CBUSbase::process(uint8_t num_messages)
-{
-   CANFrame msg;
-
-   //
-   // process FLiM UI
-   //
-
-   // allow LEDs to update
-   m_ledGrn.run();
-   m_ledYlw.run();
-
-   // allow the CBUS switch some processing time
-   m_sw.run();
 
-   // Process FLiM switch and state machine
-   FLiMSWCheck();
+uint8_t CBUSbase::getSourceWeight(RX_SOURCE source)
+{
+   return (source < RX_SOURCE::RX_NUM_SOURCES) ? m_rxWeights[static_cast<uint8_t>(source)] : 0;
+}
 
-   // Process CAN ID self-enumeration
-   processEnumeration();
+//
+/// get the number of process() runs that ended with frames from the source waiting unserved
+//
 
-   // get received CAN frames from buffer
-   // process by default 3 messages per run so the user's application code doesn't appear unresponsive under load
+uint32_t CBUSbase::getNumStarvations(RX_SOURCE source)
+{
+   return (source < RX_SOURCE::RX_NUM_SOURCES) ? m_rxStarvations[static_cast<uint8_t>(source)] : 0;
+}
 
-   uint8_t mcount = 0;
+//
+/// dispatch a burst of received frames in turn
+//
 
-   while ((available() ||                                      // Message on local queue
-         (m_gcServer != nullptr && m_gcServer->available()) || // Message on GC Server queue
-         (m_coeObj != nullptr && m_coeObj->available()))       // Message on COE queue
-         && mcount < num_messages)                             // Limit messages processed per run
+void CBUSbase::dispatchFrames(CANFrame *frames, uint8_t count)
+{
+   for (uint_fast8_t i = 0; i < count; i++)
    {
-      ++mcount;
-      msg = {}; // Clear msg buffer
-
-      // At least one CAN frame is available, either from CAN, GridConnect or an internal event
-
-      // Check for message on COE queue
-      if (m_coeObj != nullptr && m_coeObj->available())
-      {
-         msg = m_coeObj->get();
-      }
-      // Check for message on GridConnect
-      else if (m_gcServer != nullptr && m_gcServer->available())
-      {
-         msg = m_gcServer->get();
-      }
-      // Check for message on CAN
-      else if (available())
-      {
-         // Flag to indicate if we can pull from the FIFO at this time
-         bool bCanGet = true;
-
-         // Check if we can forward on Grid Connect (if we have a GC server)
-         if (m_gcServer != nullptr)
-         {
-            bCanGet = m_gcServer->canSend();
-         }
-
-         // Can we pull from the FIFO (can we send on GC server, if we have one)
-         if (bCanGet)
-         {
-            // Pull from the FIFO
-            msg = getNextMessage();
+      dispatchFrame(frames[i]);
+   }
+}
 
-            // Forward on GridConnect
-            if (m_gcServer != nullptr)
-            {
-               // Indicate if we have more data to send immediately
-               m_gcServer->sendCANFrame(msg, available());
-            }
-         }
-         else
-         {
-            // Cannot retrieve off CAN at this time, as we cannot send on GC
-            // Leave the frame in the CAN FIFO
-            continue;
-         }
-      }
-      else
-      {
-         // Shouldn't really get here, no message to process
-         continue;
-      }
+//
+/// pass a received frame to the user frame handler and the CBUS message parser
+//
 
-      // extract OPC and node number
-      uint8_t opc = msg.data[0];
-      uint16_t nodeID = (msg.data[1] << 8) + msg.data[2];
+void CBUSbase::dispatchFrame(CANFrame &msg)
+{
+   // extract OPC and node number
+   uint8_t opc = msg.data[0];
+   uint16_t nodeID = (msg.data[1] << 8) + msg.data[2];
 
-      // determine if frame is directed at this node number
-      m_bThisNN = (msg.data[0] >> 5) >= 2 && (nodeID == m_moduleConfig.getNodeNum());
+   // determine if frame is directed at this node number
+   m_bThisNN = (msg.data[0] >> 5) >= 2 && (nodeID == m_moduleConfig.getNodeNum());
 
-      //
-      /// if registered, call the user handler with this new frame
-      //
+   //
+   /// if registered, call the user handlers subscribed to this opcode
+   //
 
-      if (frameHandler != nullptr)
+   if (m_frameOpcodes[opc])
+   {
+      for (uint_fast8_t i = 0; i < m_numFrameHandlers; i++)
       {
-         // check if incoming opcode is in the user list, if list length > 0
-         if (m_numOpcodes > 0)
-         {
-            for (int_fast8_t i = 0; i < m_numOpcodes; i++)
-            {
-               if (opc == m_opcodes[i])
-               {
-                  frameHandler(msg);
-                  break;
-               }
-            }
-         }
-         else
+         if (m_frameHandlers[i].opcodes[opc])
          {
-            frameHandler(msg);
+            m_frameHandlers[i].callback(msg);
          }
       }
+   }
 
-      // Parse and process CBUS messages
-      bool bConsumed = parseCBUSMsg(msg);
-
-      /// Show activity on the LED's
-      if (m_moduleConfig.getFLiM())
-      {
-         // In FLiM the green LED is flickered on activity
-         // short ficker if not not consumed
-         m_ledGrn.pulse(!bConsumed);
-      }
-      else
-      {
-         // In SLiM the yellow LED is flickered on activity
-         // short flicker if not consumed
-         m_ledYlw.pulse(!bConsumed);
-      }
-   } // while messages available
+   // Parse and process CBUS messages
+   bool bConsumed = parseCBUSMsg(msg);
 
-   //
-   /// end of CBUS message processing
-   //
+   /// Show activity on the LED's
+   if (m_moduleConfig.getFLiM())
+   {
+      // In FLiM the green LED is flickered on activity
+      // short ficker if not not consumed
+      m_ledGrn.pulse(!bConsumed);
+   }
+   else
+   {
+      // In SLiM the yellow LED is flickered on activity
+      // short flicker if not consumed
+      m_ledYlw.pulse(!bConsumed);
+   }
 }
 
 //
@@ -822,8 +1397,17 @@ bool CBUSbase::parseCBUSEvent(CANFrame &msg)
    // Extract and cache event number
    m_eventNumber = (msg.data[3] << 8) + msg.data[4];
 
+   ++m_numEventsReceived;
+
+   // reject events this node hasn't learnt without searching the event index
+   if (!m_moduleConfig.mayHaveEvent(m_nodeNumber, m_eventNumber))
+   {
+      ++m_numEventsRejected;
+      return false;
+   }
+
    // try to find a matching stored event -- match on nn, en
-   uint8_t index = m_moduleConfig.findExistingEvent(m_nodeNumber, m_eventNumber);
+   uint16_t index = m_moduleConfig.findExistingEvent(m_nodeNumber, m_eventNumber);
 
    // call any registered event handler
 
@@ -845,6 +1429,16 @@ bool CBUSbase::parseCBUSEvent(CANFrame &msg)
          eventHandlerEx(index, msg, bOnEvent,
                         ((m_moduleConfig.EE_NUM_EVS > 0) ? m_moduleConfig.getEventEVval(index, 1) : 0));
 
+         return true; // Processed event
+      }
+      // Call event variable handler (if defined)
+      else if (eventHandlerEVs != nullptr)
+      {
+         // Determine if this is an ON or OFF event from the OPC
+         bool bOnEvent = (msg.data[0] % 2 == 0);
+
+         eventHandlerEVs(index, msg, bOnEvent, m_moduleConfig.getEventEVs(index), m_moduleConfig.getEVMirror());
+
          return true; // Processed event
       }
    }
@@ -853,221 +1447,223 @@ bool CBUSbase::parseCBUSEvent(CANFrame &msg)
 }
 
 ///
-/// @brief Process CBUS opcode for FLiM.  Called after any module specific
-/// CBUS opcodes have been dealt with.
+/// @brief Build the default opcode dispatch table, giving the conditions under which each
+/// non-event opcode is handled, and its handler
 ///
-/// @param msg reference to the received CBUS message
-/// @return true if the message was processed
-/// @return false if the message was ignored
+/// @return opcodeTable_t the opcode dispatch table
 ///
-bool CBUSbase::parseFLiMCmd(CANFrame &msg)
+constexpr opcodeTable_t CBUSbase::makeOpcodeTable(void)
 {
-   bool cmdProcessed = false;
+   opcodeTable_t table{};
 
-   if (!m_pModuleParams)
-   {
-      return cmdProcessed;
-   }
-
-   // extract the OPC
-   uint8_t opc = msg.data[0];
-
-   // extract node number and event number and cache for use in OPC processors
-   m_nodeNumber = (msg.data[1] << 8) + msg.data[2];
-   m_eventNumber = (msg.data[3] << 8) + msg.data[4];
-
-   if (m_bLearn)
-   {
-      cmdProcessed = true;
+   //
+   /// commands processed in learn mode
+   //
 
-      switch (opc)
+   table[OPC_NNLRN] = {OPC_FLAG_LEARN | OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &) {
+      if (cbus.m_bLearn)
       {
-      case OPC_NNLRN:
-         if (m_bThisNN)
+         // If in learn mode and receive a learn message for another node, we must exit learn mode
+         // Addressed to us and we're already in learn mode, nothing to do
+         if (!cbus.m_bThisNN)
          {
-            // Addressed to us and we're already in learn mode, nothing to do
-            break;
+            cbus.m_bLearn = false;
          }
-         // If in learn mode and receive a learn message for another node, we must exit learn mode
-         // fall through - no break!!
-      case OPC_NNULN:
-         // Release node from learn mode
-         m_bLearn = false;
-         break;
+      }
+      else if (cbus.m_moduleConfig.getFLiM())
+      {
+         // Put node into learn mode if we're in FLiM
+         cbus.m_bLearn = true;
+      }
+   }};
 
-      case OPC_NNCLR:
-         // Clear all events
-         doNnclr();
-         break;
+   table[OPC_NNULN] = {OPC_FLAG_LEARN, [](CBUSbase &cbus, CANFrame &) {
+      // Release node from learn mode
+      cbus.m_bLearn = false;
+   }};
 
-      case OPC_EVULN:
-         // Unlearn event
-         doEvuln();
-         break;
+   table[OPC_NNCLR] = {OPC_FLAG_LEARN, [](CBUSbase &cbus, CANFrame &) {
+      // Clear all events
+      cbus.doNnclr();
+   }};
 
-      case OPC_EVLRN:
-         // Teach event whilst in learn mode
-         doEvlrn(msg.data[5], msg.data[6]);
-         break;
+   table[OPC_EVULN] = {OPC_FLAG_LEARN, [](CBUSbase &cbus, CANFrame &) {
+      // Unlearn event
+      cbus.doEvuln();
+   }};
 
-      case OPC_EVLRNI:
-         // Teach event whilst in learn mode with event index
-         doEvlrn(msg.data[6], msg.data[7], msg.data[5]);
-         break;
+   table[OPC_EVLRN] = {OPC_FLAG_LEARN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Teach event whilst in learn mode
+      cbus.doEvlrn(msg.data[5], msg.data[6]);
+   }};
 
-      case OPC_REQEV:
-         // Read event variable by event id
-         doReqev(msg.data[5]);
-         break;
+   table[OPC_EVLRNI] = {OPC_FLAG_LEARN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Teach event whilst in learn mode with event index
+      cbus.doEvlrn(msg.data[6], msg.data[7], msg.data[5]);
+   }};
 
-      default:
-         cmdProcessed = false;
-         break;
-      }
-   } // in learn mode
+   table[OPC_REQEV] = {OPC_FLAG_LEARN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Read event variable by event id
+      cbus.doReqev(msg.data[5]);
+   }};
 
-   // process commands specifically addressed to us
-   if (!cmdProcessed && m_bThisNN)
-   {
-      cmdProcessed = true;
+   //
+   /// commands specifically addressed to us
+   //
 
-      switch (opc)
+   table[OPC_RQNPN] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Read one node parameter by index
+      cbus.doRqnpn(msg.data[3]);
+   }};
+
+   table[OPC_NNEVN] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &) {
+      // Read available event slots
+      cbus.doNnevn();
+   }};
+
+   table[OPC_NERD] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &) {
+      // Read all stored events
+      cbus.doNerd();
+   }};
+
+   table[OPC_NENRD] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Read a single stored event by index
+      cbus.doNenrd(msg.data[3]);
+   }};
+
+   table[OPC_RQEVN] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &) {
+      // Read number of stored events
+      cbus.doRqevn();
+   }};
+
+   table[OPC_NVRD] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Read value of a node variable
+      cbus.doNvrd(msg.data[3]);
+   }};
+
+   table[OPC_NVSET] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Set a node variable
+      cbus.doNvset(msg.data[3], msg.data[4]);
+   }};
+
+   table[OPC_REVAL] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &msg) {
+      // Read event variable by index
+      cbus.doReval(msg.data[3], msg.data[4]);
+   }};
+
+   table[OPC_CANID] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &msg) {
+      if (!cbus.m_moduleConfig.setCANID(msg.data[3]))
       {
-      case OPC_RQNPN:
-         // Read one node parameter by index
-         doRqnpn(msg.data[3]);
-         break;
+         cbus.sendCMDERR(CMDERR_INVALID_EVENT); // seems a strange error code but that's what the spec says...
+      }
+   }};
 
-      case OPC_NNLRN:
-         // Put node into learn mode if we're in FLiM
-         if (m_moduleConfig.getFLiM())
-         {
-            m_bLearn = true;
-         }
-         break;
+   table[OPC_ENUM] = {OPC_FLAG_NN, [](CBUSbase &cbus, CANFrame &) {
+      cbus.doEnum(true);
+   }};
 
-      case OPC_NNEVN:
-         // Read available event slots
-         doNnevn();
-         break;
+   //
+   /// commands not sent specifically to us that still need action
+   //
 
-      case OPC_NERD:
-         // Read all stored events
-         doNerd();
-         break;
+   table[OPC_QNN] = {OPC_FLAG_ANY, [](CBUSbase &cbus, CANFrame &) {
+      cbus.QNNrespond(); // Respond to node query 	//  ??? update to do new spec response agreed
+   }};
 
-      case OPC_NENRD:
-         // Read a single stored event by index
-         doNenrd(msg.data[3]);
-         break;
+   //
+   /// FLiM commands not addressed to any particular node, processed in setup mode
+   //
 
-      case OPC_RQEVN:
-         // Read number of stored events
-         doRqevn();
-         break;
+   table[OPC_RQNP] = {OPC_FLAG_SETUP, [](CBUSbase &cbus, CANFrame &) {
+      // Read node parameters
+      cbus.doRqnp();
+   }};
 
-      case OPC_NVRD:
-         // Read value of a node variable
-         doNvrd(msg.data[3]);
-         break;
+   table[OPC_RQMN] = {OPC_FLAG_SETUP, [](CBUSbase &cbus, CANFrame &) {
+      // Read module type name
+      cbus.doRqmn();
+   }};
 
-      case OPC_NVSET:
-         // Set a node variable
-         doNvset(msg.data[3], msg.data[4]);
-         break;
+   table[OPC_SNN] = {OPC_FLAG_SETUP, [](CBUSbase &cbus, CANFrame &) {
+      // Set node number
+      cbus.doSnn();
+   }};
 
-      case OPC_REVAL:
-         // Read event variable by index
-         doReval(msg.data[3], msg.data[4]);
-         break;
+   return table;
+}
 
-#ifdef BOOTLOADER_PRESENT
-      case OPC_BOOT:
-         // Enter bootloader mode
-         ee_write((WORD)EE_BOOT_FLAG, 0xFF);
-         Reset();
-         break;
-#endif
+/// Default opcode dispatch table, built at compile time
+static constexpr opcodeTable_t defaultOpcodeTable = CBUSbase::makeOpcodeTable();
 
-      case OPC_CANID:
-         if (!m_moduleConfig.setCANID(msg.data[3]))
-         {
-            sendCMDERR(CMDERR_INVALID_EVENT); // seems a strange error code but that's what the spec says...
-         }
-         break;
+///
+/// @brief Get the default opcode dispatch table, a module may copy it and add or
+/// replace entries, before passing its own table to CBUSbase::setOpcodeTable
+///
+/// @return const opcodeTable_t& the default opcode dispatch table
+///
+const opcodeTable_t &CBUSbase::getDefaultOpcodeTable(void)
+{
+   return defaultOpcodeTable;
+}
 
-      case OPC_ENUM:
-         doEnum(true);
-         break;
+///
+/// @brief Replace the opcode dispatch table used by parseFLiMCmd
+///
+/// @param table opcode dispatch table, must have a lifetime longer than the CBUS object
+///
+void CBUSbase::setOpcodeTable(const opcodeTable_t &table)
+{
+   m_pOpcodeTable = &table;
+}
 
-      default:
-         cmdProcessed = false;
-         break;
-      }
-   } // this NN
+///
+/// @brief Process CBUS opcode for FLiM.  Called after any module specific
+/// CBUS opcodes have been dealt with.  The opcode is looked up in the opcode dispatch
+/// table, so frames that need no action in the current state are rejected immediately
+///
+/// @param msg reference to the received CBUS message
+/// @return true if the message was processed
+/// @return false if the message was ignored
+///
+bool CBUSbase::parseFLiMCmd(CANFrame &msg)
+{
+   if (!m_pModuleParams)
+   {
+      return false;
+   }
 
-   if (!cmdProcessed)
-   { // Process any command not sent specifically to us that still needs action
-      switch (msg.data[0])
-      {
-#ifdef AREQ_SUPPORT
-      case OPC_AREQ:
-         // Illicit a response indicating last long event state
-         // The NN supplied is actually the Long event's NN instead of the addressed module
-         // but these should be the same for the producer of the event.
-         doAreq((((WORD)msg.data[d1]) << 8) + msg.data[d2], (((WORD)msg.data[d3]) << 8) + msg.data[d4]);
-         cmdProcessed = TRUE;
-         break;
+   const OPCODE_DESC_t &desc = (*m_pOpcodeTable)[msg.data[0]];
 
-      case OPC_ASRQ:
-         // Illicit a response indicating last short event state
-         // The NN supplied can either be zero (short event) or the NN of the producer module
-         // Any module that produces that short event can respond if the NN is zero, if it is non-zero, then only that producer module should respond.
-         if (((((WORD)msg.data[d1]) << 8) + msg.data[d2] == 0) || m_bThisNN(msg.data))
-         {
-            doAreq(0, (((WORD)msg.data[d3]) << 8) + msg.data[d4]);
-            cmdProcessed = TRUE;
-         }
-         break;
-#endif
-      case OPC_QNN:
-         QNNrespond(); // Respond to node query 	//  ??? update to do new spec response agreed
-         cmdProcessed = true;
-         break;
-      }
-   }
+   // Determine the conditions that currently allow an opcode to be handled
+   uint8_t active = OPC_FLAG_ANY;
 
-   // In setup mode, also check for FLiM commands not addressed to
-   // any particular node
+   if (m_bLearn)
+   {
+      active |= OPC_FLAG_LEARN;
+   }
 
-   if ((!cmdProcessed) && (m_flimState == fsState::fsFLiMSetup))
+   if (m_bThisNN)
    {
-      cmdProcessed = true;
+      active |= OPC_FLAG_NN;
+   }
 
-      switch (msg.data[0])
-      {
-      case OPC_RQNP:
-         // Read node parameters
-         doRqnp();
-         break;
+   if (m_flimState == fsState::fsFLiMSetup)
+   {
+      active |= OPC_FLAG_SETUP;
+   }
 
-      case OPC_RQMN:
-         // Read module type name
-         doRqmn();
-         break;
+   if (!(desc.flags & active) || (desc.handler == nullptr))
+   {
+      return false;
+   }
 
-      case OPC_SNN:
-         // Set node number
-         doSnn();
-         break;
+   // extract node number and event number and cache for use in OPC processors
+   m_nodeNumber = (msg.data[1] << 8) + msg.data[2];
+   m_eventNumber = (msg.data[3] << 8) + msg.data[4];
 
-      default:
-         cmdProcessed = false;
-         break;
-      }
-   }
+   desc.handler(*this, msg);
 
-   return (cmdProcessed);
+   return true;
 }
 
 ///
@@ -1280,8 +1876,8 @@ void CBUSbase::doEvlrn(const uint8_t evNum, const uint8_t evVal, const uint8_t e
    ////// @todo APP callback
 
    // If the event index is provided, use that
-   uint8_t index;
-   if (evIdx < m_moduleConfig.EE_MAX_EVENTS)
+   uint16_t index;
+   if (evIdx != EVENT_INDEX_NONE && evIdx < m_moduleConfig.EE_MAX_EVENTS)
    {
       index = evIdx;
    }
@@ -1340,8 +1936,8 @@ void CBUSbase::doReval(const uint8_t enNum, const uint8_t evNum)
       return;
    }
 
-   // Checks valid event number
-   if (m_moduleConfig.getEvTableEntry(enNum) != 0)
+   // Checks valid event number, events beyond the 8-bit index range can't be read by index
+   if (enNum != EVENT_INDEX_NONE && m_moduleConfig.getEvTableEntry(enNum) != 0)
    {
       // return request event variable
       sendOpcMyNN(OPC_NEVAL, 3, enNum, evNum, m_moduleConfig.getEventEVval(enNum, evNum));
@@ -1359,7 +1955,7 @@ void CBUSbase::doReval(const uint8_t enNum, const uint8_t evNum)
 void CBUSbase::doEvuln()
 {
    // search for this NN and EN pair
-   uint8_t index = m_moduleConfig.findExistingEvent(m_nodeNumber, m_eventNumber);
+   uint16_t index = m_moduleConfig.findExistingEvent(m_nodeNumber, m_eventNumber);
 
    if (index < m_moduleConfig.EE_MAX_EVENTS)
    {
@@ -1393,7 +1989,7 @@ void CBUSbase::doReqev(const uint8_t evNum)
    }
 
    // search for this NN and EN pair
-   uint8_t index = m_moduleConfig.findExistingEvent(m_nodeNumber, m_eventNumber);
+   uint16_t index = m_moduleConfig.findExistingEvent(m_nodeNumber, m_eventNumber);
 
    // Checks valid event number
    if (index < m_moduleConfig.EE_MAX_EVENTS)
@@ -1414,15 +2010,13 @@ void CBUSbase::doReqev(const uint8_t evNum)
 ///
 void CBUSbase::doNnevn()
 {
-   uint8_t free_slots = 0;
+   // stored events are counted as they are learnt and unlearnt
+   uint16_t free_slots = m_moduleConfig.EE_MAX_EVENTS - m_moduleConfig.numEvents();
 
-   // count free slots using the event hash table
-   for (int_fast8_t i = 0; i < m_moduleConfig.EE_MAX_EVENTS; i++)
+   // the response carries a single byte, so saturate on large event tables
+   if (free_slots > UINT8_MAX)
    {
-      if (m_moduleConfig.getEvTableEntry(i) == 0)
-      {
-         ++free_slots;
-      }
+      free_slots = UINT8_MAX;
    }
 
    // Send response with number of free event table slots
@@ -1430,42 +2024,62 @@ void CBUSbase::doNnevn()
 }
 
 ///
-/// @brief Read all stored events
+/// @brief Read all stored events, the ENRSP responses are streamed by process()
 ///
 void CBUSbase::doNerd()
 {
-   /// @todo investigate timed response code in PIC lib
+   // Start, or restart, the stream of ENRSP responses, sent by process()
+   m_streamType = RESPONSE_STREAM::STREAM_NERD;
+   m_streamIndex = 0;
+}
 
-   CANFrame msg;
-   msg.len = 8;
-   msg.data[0] = OPC_ENRSP;              // response opcode
-   msg.data[1] = highByte(m_nodeNumber); // my NN hi
-   msg.data[2] = lowByte(m_nodeNumber);  // my NN lo
+///
+/// @brief Send the next frames of a multi-frame response, up to STREAM_BURST_LEN frames
+/// per call.  When the transmit queue is full the response is resumed on the next call
+/// to process(), rather than waiting for the queue to drain
+///
+void CBUSbase::processStream(void)
+{
+   uint8_t sent = 0;
 
-   // Loop for all events in the event table
-   for (int_fast8_t i = 0; i < m_moduleConfig.EE_MAX_EVENTS; i++)
+   while ((m_streamType == RESPONSE_STREAM::STREAM_NERD) && (sent < STREAM_BURST_LEN))
    {
-      // Check for valid event
-      if (m_moduleConfig.getEvTableEntry(i) != 0)
+      // Find the next valid stored event, skipping empty slots through the free map
+      m_streamIndex = m_moduleConfig.findNextEvent(m_streamIndex);
+
+      if (m_streamIndex >= m_moduleConfig.EE_MAX_EVENTS)
       {
-         // it's a valid stored event
+         // All stored events sent
+         m_streamType = RESPONSE_STREAM::STREAM_NONE;
+         break;
+      }
 
-         // read the event data from EEPROM
-         // construct and send a ENRSP message
-         EVENT_INFO_t evInfo;
-         m_moduleConfig.readEvent(i, evInfo);
+      // read the event data from EEPROM
+      // construct and send a ENRSP message
+      EVENT_INFO_t evInfo;
+      m_moduleConfig.readEvent(m_streamIndex, evInfo);
 
-         msg.data[3] = highByte(evInfo.nodeNumber);
-         msg.data[4] = lowByte(evInfo.nodeNumber);
-         msg.data[5] = highByte(evInfo.eventNumber);
-         msg.data[6] = lowByte(evInfo.eventNumber);
-         msg.data[7] = i; // event table index
+      uint16_t nodeNumber = m_moduleConfig.getNodeNum();
 
-         while (!sendMessage(msg))
-         {
-            ; // busy waiting to send
-         }
+      CANFrame msg;
+      msg.len = 8;
+      msg.data[0] = OPC_ENRSP;            // response opcode
+      msg.data[1] = highByte(nodeNumber); // my NN hi
+      msg.data[2] = lowByte(nodeNumber);  // my NN lo
+      msg.data[3] = highByte(evInfo.nodeNumber);
+      msg.data[4] = lowByte(evInfo.nodeNumber);
+      msg.data[5] = highByte(evInfo.eventNumber);
+      msg.data[6] = lowByte(evInfo.eventNumber);
+      msg.data[7] = (m_streamIndex < EVENT_INDEX_NONE) ? m_streamIndex : EVENT_INDEX_NONE; // event table index
+
+      if (!sendMessage(msg))
+      {
+         // Transmit queue full, resume from this event on the next call
+         break;
       }
+
+      m_streamIndex++;
+      sent++;
    }
 }
 
@@ -1478,8 +2092,8 @@ void CBUSbase::doNenrd(const uint8_t index)
 {
    /// @todo - validate behaviour
 
-   // Check for valid index
-   if (m_moduleConfig.getEvTableEntry(index) == 0)
+   // Check for valid index, events beyond the 8-bit index range can't be read by index
+   if (index == EVENT_INDEX_NONE || m_moduleConfig.getEvTableEntry(index) == 0)
    {
       // invalid index
       sendCMDERR(CMDERR_INVALID_EVENT);
@@ -1509,8 +2123,9 @@ void CBUSbase::doNenrd(const uint8_t index)
 ///
 void CBUSbase::doRqevn()
 {
-   // respond with 0x74 NUMEV
-   sendOpcMyNN(OPC_NUMEV, 1, m_moduleConfig.numEvents());
+   // respond with 0x74 NUMEV, the response carries a single byte, so saturate on large event tables
+   uint16_t num_events = m_moduleConfig.numEvents();
+   sendOpcMyNN(OPC_NUMEV, 1, (num_events > UINT8_MAX) ? UINT8_MAX : num_events);
 }
 
 ///
@@ -1719,14 +2334,23 @@ void CBUSbase::processEnumeration(void)
 /// consume own events class
 //
 
-CBUScoe::CBUScoe(const uint8_t num_items)
+CBUScoe::CBUScoe(const uint8_t num_items) : m_bOwnsBuffer{true}
 {
    coe_buff = new (std::nothrow) CBUSCircularBuffer(num_items);
 }
 
+//
+/// use a buffer owned by a derived class, e.g. CBUScoeT
+//
+
+CBUScoe::CBUScoe(CBUSCircularBuffer &buffer) : coe_buff{&buffer},
+                                              m_bOwnsBuffer{false}
+{
+}
+
 CBUScoe::~CBUScoe()
 {
-   if (coe_buff)
+   if (coe_buff && m_bOwnsBuffer)
    {
       delete coe_buff;
    }
@@ -1752,6 +2376,16 @@ bool CBUScoe::available()
    return coe_buff->available();
 }
 
+uint8_t CBUScoe::getMessages(CANFrame *out, uint8_t max)
+{
+   if (!coe_buff)
+   {
+      return 0;
+   }
+
+   return coe_buff->getMessages(out, max);
+}
+
 CANFrame CBUScoe::get()
 {
    if (!coe_buff)
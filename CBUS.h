@@ -41,6 +41,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <array>
+#include <atomic>
+#include <bitset>
 
 #include "CBUSLED.h"
 #include "CBUSSwitch.h"
@@ -55,6 +58,12 @@
 #define LONG_MESSAGE_RECEIVE_TIMEOUT 5000 ///< timeout waiting for next long message packet
 #define NUM_EX_CONTEXTS 4                 ///< number of send and receive contexts for extended implementation = number of concurrent messages
 #define EX_BUFFER_LEN 64                  ///< size of extended send and receive buffers
+#define PROCESS_BURST_LEN 8               ///< maximum number of frames drained from a queue per call in process()
+#define MAX_FRAME_HANDLERS 4              ///< maximum number of registered user frame handlers
+#define RX_SOURCE_DEFAULT_WEIGHT 4        ///< default number of frames a receive source may deliver per scheduling round
+#define HOUSEKEEPING_INTERVAL 10          ///< interval in milliseconds between LED, switch and enumeration updates in event-driven mode
+#define STREAM_BURST_LEN 4                ///< maximum number of frames of a multi-frame response sent per call to process()
+#define EVENT_INDEX_NONE 0xFF             ///< event index byte of ENRSP / EVLRNI for an event beyond the range of index based opcodes
 
 // FLiM timing constants
 #define ONE_SECOND 1000U
@@ -95,6 +104,31 @@ enum class fsState
    fsUnknown       ///< Unknown FLiM mode
 };
 
+//
+/// Enumeration of receive sources served by process()
+//
+
+enum class RX_SOURCE : uint8_t
+{
+   RX_SOURCE_COE, ///< Consume own events queue
+   RX_SOURCE_GC,  ///< GridConnect server
+   RX_SOURCE_CAN, ///< CAN transport
+   RX_NUM_SOURCES ///< Number of receive sources
+};
+
+/// Number of receive sources served by process()
+constexpr uint8_t RX_NUM_SOURCES = static_cast<uint8_t>(RX_SOURCE::RX_NUM_SOURCES);
+
+//
+/// Enumeration of multi-frame responses, sent as a stream advanced by process()
+//
+
+enum class RESPONSE_STREAM : uint8_t
+{
+   STREAM_NONE, ///< No response in progress
+   STREAM_NERD  ///< ENRSP for each stored event, in response to NERD
+};
+
 //
 /// Enumeration CBUS long message status codes
 //
@@ -126,17 +160,65 @@ typedef struct module_name_t
 // Callback function definitions
 
 /// Standard event callback type
-using eventCallback_t = void (*)(uint8_t index, const CANFrame &msg);
+using eventCallback_t = void (*)(uint16_t index, const CANFrame &msg);
 
 /// Extended event callback type
-using eventExCallback_t = void (*)(uint8_t index, const CANFrame &msg, bool ison, uint8_t evval);
+using eventExCallback_t = void (*)(uint16_t index, const CANFrame &msg, bool ison, uint8_t evval);
+
+/// Event callback type receiving the event variables mirrored in RAM, see CBUSConfig::setEVMirror()
+using eventEVsCallback_t = void (*)(uint16_t index, const CANFrame &msg, bool ison, const uint8_t *evs, uint8_t numEVs);
 
 /// Frame callback type
 using frameCallback_t = void (*)(CANFrame &msg);
 
+/// Opcode subscription bitmap, bit n set if the frame handler receives opcode n
+using opcodeMask_t = std::bitset<256>;
+
+/// A registered user frame handler and the opcodes it subscribes to
+typedef struct
+{
+   frameCallback_t callback; ///< Handler called with each subscribed frame
+   opcodeMask_t opcodes;     ///< Opcodes passed to the handler
+} FRAME_HANDLER_t;
+
+/// An event to be sent by CBUSbase::sendEvents
+typedef struct
+{
+   uint16_t nodeNumber;  ///< Event node number, 0 for a short event
+   uint16_t eventNumber; ///< Event number
+   bool onEvent;         ///< true for an ON event, false for an OFF event
+   uint8_t dataLen;      ///< Number of optional data bytes [0-3]
+   uint8_t data[3];      ///< Optional event data
+} EVENT_SEND_t;
+
+/// Event batch completion callback type
+using eventBatchCallback_t = void (*)(const EVENT_SEND_t *events, uint16_t numEvents);
+
 /// Long Message callback type
 using longMessageCallback_t = void (*)(void *fragment, const uint32_t fragment_len, const uint8_t stream_id, const uint8_t status);
 
+// Opcode dispatch table definitions
+
+class CBUSbase;
+
+/// Opcode handler type, called with the CBUS object that received the frame
+using opcodeHandler_t = void (*)(CBUSbase &cbus, CANFrame &msg);
+
+constexpr uint8_t OPC_FLAG_LEARN = 0x01; ///< Opcode is handled in learn mode, whichever node it is addressed to
+constexpr uint8_t OPC_FLAG_NN = 0x02;    ///< Opcode is handled when addressed to this node number
+constexpr uint8_t OPC_FLAG_ANY = 0x04;   ///< Opcode is handled by every node
+constexpr uint8_t OPC_FLAG_SETUP = 0x08; ///< Opcode is handled in FLiM setup mode
+
+/// Describes how a non-event opcode is processed
+typedef struct
+{
+   uint8_t flags;           ///< OPC_FLAG_ conditions under which the handler is called, 0 if the opcode is ignored
+   opcodeHandler_t handler; ///< Handler for the opcode
+} OPCODE_DESC_t;
+
+/// Opcode dispatch table, indexed by opcode
+using opcodeTable_t = std::array<OPCODE_DESC_t, 256>;
+
 //
 /// @brief An abstract class to encapsulate CAN bus and CBUS processing for a CBUS module,
 /// it must be implemented by a derived subclass
@@ -157,6 +239,19 @@ public:
    virtual bool sendMessage(CANFrame &msg, bool rtr = false, bool ext = false, uint8_t priority = DEFAULT_PRIORITY) = 0;
    virtual void reset(void) = 0;
 
+   // may be overridden by the derived class to drain its receive queue in a single call
+   virtual uint8_t getMessages(CANFrame *out, uint8_t max);
+
+   // may be overridden by the derived class to expose its receive queue depth to process()
+   virtual CBUSCircularBuffer *getRxQueue(void) { return nullptr; }
+
+   // may be overridden by the derived class to resume deferred transmissions, called by process()
+   virtual void serviceTransmit(void) {}
+
+   // may be overridden by the derived class to report frames deferred by a transmit rate limit,
+   // and the time in microseconds until the next may be sent, used by waitForWork()
+   virtual bool txPending(uint32_t & /* wait_us */) { return false; }
+
    // implementations of these methods are provided in the base class
 
    void FLiMSWCheck(void);
@@ -168,11 +263,27 @@ public:
    bool sendMyEvent(const uint16_t eventNum, const bool onEvent);
    bool sendEvent(const uint16_t eventNode, const uint16_t eventNum, const bool onEvent);
    bool sendEventWithData(uint16_t eventNode, const uint16_t eventNum, const bool onEvent, const uint8_t dataLen = 0, const uint8_t d1 = 0, const uint8_t d2 = 0, const uint8_t d3 = 0);
+   bool sendEvents(const EVENT_SEND_t *events, const uint16_t numEvents, eventBatchCallback_t callback = nullptr);
+   inline bool eventBatchActive(void) { return m_batchEvents != nullptr; }
    bool sendDataEvent(const uint16_t nodeId, const uint8_t d1 = 0, const uint8_t d2 = 0, const uint8_t d3 = 0, const uint8_t d4 = 0, const uint8_t d5 = 0);
 
    bool sendWRACK(void);
    bool sendCMDERR(uint8_t cerrno);
    void process(uint8_t num_messages = 3);
+   void setProcessBudget(uint32_t budget_us);
+   inline uint32_t getProcessBudget(void) { return m_processBudget; }
+   void setAdaptiveBatch(bool bAdaptive);
+   inline uint32_t getNumBudgetExpiries(void) { return m_numBudgetExpiries; }
+   void setSourceWeight(RX_SOURCE source, uint8_t weight);
+   uint8_t getSourceWeight(RX_SOURCE source);
+   uint32_t getNumStarvations(RX_SOURCE source);
+   inline uint32_t getNumEventsReceived(void) { return m_numEventsReceived; }
+   inline uint32_t getNumEventsRejected(void) { return m_numEventsRejected; }
+   void setEventDriven(bool bEventDriven, uint32_t interval_ms = HOUSEKEEPING_INTERVAL);
+   bool workPending(void);
+   void waitForWork(uint32_t max_wait_ms = UINT32_MAX);
+   static void signalWakeup(void);
+   inline bool streamActive(void) { return m_streamType != RESPONSE_STREAM::STREAM_NONE; }
    void initFLiM(void);
    void revertSLiM(void);
    void setSLiM(void);
@@ -183,7 +294,13 @@ public:
    void indicateFLiMMode(bool bFLiM);
    void setEventHandlerCB(eventCallback_t evCallback);
    void setEventHandlerExCB(eventExCallback_t evExCallback);
+   void setEventHandlerEVsCB(eventEVsCallback_t evEVsCallback);
    void setFrameHandler(frameCallback_t, uint8_t *opcodes = nullptr, uint8_t num_opcodes = 0);
+   bool addFrameHandler(frameCallback_t frameCallback, const opcodeMask_t &opcodes);
+   bool removeFrameHandler(frameCallback_t frameCallback);
+   static opcodeMask_t makeOpcodeMask(const uint8_t *opcodes, uint8_t num_opcodes);
+   void setOpcodeTable(const opcodeTable_t &table);
+   static const opcodeTable_t &getDefaultOpcodeTable(void);
    void makeHeader(CANFrame &msg, uint8_t priority = DEFAULT_PRIORITY);
 
    // CAN ID Self-enumeration handling
@@ -200,9 +317,19 @@ public:
    virtual void actUponNVchange(const uint8_t NVindex, const uint8_t oldValue, const uint8_t NVvalue);
 
    // Message Parsers
+   uint8_t getProcessBatch(uint8_t num_messages);
+   uint8_t processSource(RX_SOURCE source, uint8_t nwanted);
+   bool sourceAvailable(RX_SOURCE source);
+   bool housekeepingDue(void);
+   void processStream(void);
+   void processEventBatch(void);
+   uint16_t makeEventFrame(CANFrame &frame, uint16_t eventNode, const uint16_t eventNum, const bool onEvent, const uint8_t dataLen, const uint8_t d1, const uint8_t d2, const uint8_t d3);
+   void dispatchFrame(CANFrame &msg);
+   void dispatchFrames(CANFrame *frames, uint8_t count);
    bool parseCBUSMsg(CANFrame &msg);
    bool parseCBUSEvent(CANFrame &msg);
    bool parseFLiMCmd(CANFrame &msg);
+   static constexpr opcodeTable_t makeOpcodeTable(void);
 
    // Message Processors
    uint8_t getParFlags(void);
@@ -215,7 +342,7 @@ public:
    void doSnn(void);
 
    void doNnclr(void);
-   void doEvlrn(const uint8_t evNum, const uint8_t evVal, const uint8_t evIdx=0xFF);
+   void doEvlrn(const uint8_t evNum, const uint8_t evVal, const uint8_t evIdx=EVENT_INDEX_NONE);
    void doReval(const uint8_t enNum, const uint8_t evNum);
    void doEvuln(void);
    void doReqev(const uint8_t evNum);
@@ -241,9 +368,10 @@ protected: // protected members become private in derived classes
    module_name_t *m_pModuleName;
    eventCallback_t eventHandler;
    eventExCallback_t eventHandlerEx;
-   frameCallback_t frameHandler;
-   uint8_t *m_opcodes;
-   uint8_t m_numOpcodes;
+   eventEVsCallback_t eventHandlerEVs;
+   FRAME_HANDLER_t m_frameHandlers[MAX_FRAME_HANDLERS];
+   uint8_t m_numFrameHandlers;
+   opcodeMask_t m_frameOpcodes; // union of all frame handler subscriptions
    uint8_t m_enumResponses[ENUM_ARRAY_SIZE];
    bool m_bLearn;
    bool m_bThisNN;
@@ -261,6 +389,37 @@ protected: // protected members become private in derived classes
    CBUSLongMessage *longMessageHandler; // CBUS long message object to receive relevant frames
    CBUSGridConnect *m_gcServer;         // CBUS grid connect server
    CBUScoe *m_coeObj;                   // consume-own-events
+   const opcodeTable_t *m_pOpcodeTable; // non-event opcode dispatch table
+
+   uint32_t m_processBudget;     // microseconds of frame processing per process() call, 0 if unlimited
+   uint32_t m_numBudgetExpiries; // number of process() calls ended by the time budget
+   uint32_t m_frameCost;         // running average of microseconds taken to process a frame
+   bool m_bAdaptiveBatch;        // scale frames processed per call with receive queue depth
+   uint8_t m_rxHighWaterMark;    // receive queue high water mark seen by the previous call
+
+   uint8_t m_rxWeights[RX_NUM_SOURCES];      // frames each source may deliver per scheduling round
+   uint32_t m_rxStarvations[RX_NUM_SOURCES]; // runs ending with the source waiting unserved
+   uint8_t m_rxSource;                       // source currently being served
+   uint8_t m_rxServed;                       // frames delivered by the current source this round
+
+   bool m_bEventDriven;              // housekeeping runs on an interval, the application sleeps in waitForWork()
+   uint32_t m_housekeepingInterval;  // milliseconds between housekeeping runs in event-driven mode
+   uint32_t m_lastHousekeeping;      // time of the last housekeeping run
+   inline static std::atomic<bool> s_bWakeup{false}; // set by interrupt handlers when work is queued
+
+   RESPONSE_STREAM m_streamType; // multi-frame response in progress
+   uint16_t m_streamIndex;       // next event table index of the response
+
+   const EVENT_SEND_t *m_batchEvents;    // event batch being sent, nullptr if none
+   uint16_t m_batchNumEvents;            // number of events in the batch
+   uint16_t m_batchNext;                 // next event of the batch to send
+   eventBatchCallback_t m_batchCallback; // called when the batch has been sent
+
+   uint32_t m_numEventsReceived; // events passed to parseCBUSEvent()
+   uint32_t m_numEventsRejected; // events rejected by the learnt event prefilter
+
+private:
+   CANFrame m_rxStage[PROCESS_BURST_LEN]; // burst of frames unpacked from the receive queues
 };
 
 //
@@ -378,8 +537,28 @@ public:
    CBUScoe(CBUScoe &) = delete;
    void put(const CANFrame &msg);
    CANFrame get(void);
+   uint8_t getMessages(CANFrame *out, uint8_t max);
    bool available(void);
 
+protected:
+   explicit CBUScoe(CBUSCircularBuffer &buffer);
+
 private:
    CBUSCircularBuffer *coe_buff;
+   bool m_bOwnsBuffer;
+};
+
+//
+/// A consume-own-events queue with statically allocated storage of N slots
+/// N must be a power of two, the queue holds up to N - 1 events
+//
+
+template <uint32_t N>
+class CBUScoeT : public CBUScoe
+{
+public:
+   CBUScoeT() : CBUScoe(m_queue) {}
+
+private:
+   CBUSCircularBufferT<N> m_queue;
 };
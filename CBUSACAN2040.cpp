@@ -47,6 +47,7 @@
 #include <cstring>
 
 #include <RP2040.h>
+#include <hardware/sync.h>
 
 // static pointer to object
 CBUSACAN2040 *acan2040p;
@@ -62,12 +63,11 @@ static __attribute__((section(".RAM"))) void cb(struct can2040 *cd, uint32_t not
 //
 
 CBUSACAN2040::CBUSACAN2040(CBUSConfig &config) : CBUSbase(config),
-                                                 tx_buffer{nullptr},
                                                  rx_buffer{nullptr},
                                                  _gpio_tx{0x0U},
                                                  _gpio_rx{0x0U},
-                                                 _num_tx_buffers{tx_qsize},
-                                                 _num_rx_buffers{rx_qsize}
+                                                 _tx_queue{},
+                                                 _rx_queue{}
 {
    initMembers();
 }
@@ -79,17 +79,7 @@ void CBUSACAN2040::initMembers(void)
 
 CBUSACAN2040::~CBUSACAN2040()
 {
-   if (rx_buffer)
-   {
-      delete rx_buffer;
-      rx_buffer = nullptr;
-   }
-
-   if (tx_buffer)
-   {
-      delete tx_buffer;
-      tx_buffer = nullptr;
-   }
+   rx_buffer = nullptr;
 
    if (acan2040)
    {
@@ -105,13 +95,12 @@ CBUSACAN2040::~CBUSACAN2040()
 
 bool CBUSACAN2040::begin()
 {
-   // allocate tx and tx buffers -- tx is currently unused
-   rx_buffer = new (std::nothrow) CBUSCircularBuffer(_num_rx_buffers);
-   tx_buffer = new (std::nothrow) CBUSCircularBuffer(_num_tx_buffers);
+   // attach the statically allocated rx buffer
+   rx_buffer = &_rx_queue;
 
    acan2040 = new (std::nothrow) ACAN2040(0, _gpio_tx, _gpio_rx, CANBITRATE, SystemCoreClock, cb);
 
-   if (!rx_buffer || !tx_buffer || !acan2040)
+   if (!acan2040)
    {
       return false;
    }
@@ -161,6 +150,33 @@ CANFrame CBUSACAN2040::getNextMessage(void)
    return *pFrame;
 }
 
+//
+/// retrieve a burst of messages from the receive buffer
+//
+
+uint8_t CBUSACAN2040::getMessages(CANFrame *out, uint8_t max)
+{
+   if (!rx_buffer)
+   {
+      return 0;
+   }
+
+   uint8_t count = rx_buffer->getMessages(out, max);
+
+   m_numMsgsRcvd += count;
+
+   return count;
+}
+
+//
+/// the receive queue, used by process() to scale the frames processed per call
+//
+
+CBUSCircularBuffer *CBUSACAN2040::getRxQueue(void)
+{
+   return rx_buffer;
+}
+
 //
 /// callback - locate in RAM
 //
@@ -191,12 +207,15 @@ void __attribute__((section(".RAM"))) CBUSACAN2040::notify_cb(struct can2040 *cd
          if (checkIncomingFrame(msg))
          {
             rx_buffer->put(msg);
+            signalWakeup();
          }
       }
       break;
 
    case CAN2040_NOTIFY_TX:
-      // Notify Tx Complete
+      // Notify Tx Complete - send the next queued frames
+      drainTxQueue();
+      signalWakeup();
       break;
    case CAN2040_NOTIFY_ERROR:
       // Notify CAN Error
@@ -208,59 +227,189 @@ void __attribute__((section(".RAM"))) CBUSACAN2040::notify_cb(struct can2040 *cd
 }
 
 //
-/// send a CBUS message
+/// send a CBUS message, the frame is queued by priority and transmitted as the controller
+/// becomes free, so this only fails if the queue for the frame's priority is full
 //
 
 bool CBUSACAN2040::sendMessage(CANFrame &msg, bool rtr, bool ext, uint8_t priority)
 {
-   struct can2040_msg tx_msg;
-
    // caller must populate the message data
    // this method will create the correct frame header (CAN ID and priority bits)
    // rtr and ext default to false unless arguments are supplied - see method definition in .h
    // priority defaults to 1011 low/medium
 
-   if (!acan2040->ok_to_send())
+   makeHeader(msg, priority); // default priority unless user overrides
+
+   msg.rtr = rtr;
+   msg.ext = ext;
+
+   if (!queueFrame(msg))
    {
-      // Serial.print("no space available to send message");
       return false;
    }
 
-   // Send the frame to GC
-   // Forward all received CAN messages to GridConnect clients
+   // Forward all sent CAN messages to GridConnect clients
    if (m_gcServer)
    {
       m_gcServer->sendCANFrame(msg, false);
    }
 
-   makeHeader(msg, priority); // default priority unless user overrides
+   return true;
+}
 
-   if (rtr)
+//
+/// queue a frame for transmission by its CBUS major priority, and start transmission
+/// if the controller is idle. Interrupts are disabled so the queue is not drained by
+/// the tx complete callback at the same time
+//
+
+bool CBUSACAN2040::queueFrame(const CANFrame &msg)
+{
+   // Major priority is held in bits 9-10 of the 11 bit CAN ID, the upper 11 bits of an extended ID
+   uint8_t major = msg.ext ? ((msg.id >> 27) & 0x03) : ((msg.id >> 9) & 0x03);
+   CBUSCircularBuffer &queue = _tx_queue[major];
+   bool bQueued = false;
+
+   uint32_t status = save_and_disable_interrupts();
+
+   if (acan2040 && !queue.full())
    {
-      msg.id |= 0x40000000;
+      queue.put(msg);
+      drainTxQueue();
+      bQueued = true;
    }
 
-   if (ext)
+   restore_interrupts(status);
+
+   return bQueued;
+}
+
+//
+/// limit the transmit rate of a CBUS major priority class, frames over the limit are
+/// deferred in the transmit queue, a rate of zero removes the limit
+//
+
+void CBUSACAN2040::setTxRateLimit(uint8_t major_priority, uint32_t frames_per_sec, uint32_t burst)
+{
+   uint32_t status = save_and_disable_interrupts();
+
+   _tx_limiter.setRate(major_priority, frames_per_sec, burst);
+
+   restore_interrupts(status);
+}
+
+//
+/// the number of times a frame of a CBUS major priority class was deferred by the rate limit
+//
+
+uint32_t CBUSACAN2040::getNumTxDeferred(uint8_t major_priority)
+{
+   return _tx_limiter.getNumDeferred(major_priority);
+}
+
+//
+/// resume transmission of frames deferred by the rate limit, called by process()
+//
+
+void CBUSACAN2040::serviceTransmit(void)
+{
+   uint32_t status = save_and_disable_interrupts();
+
+   drainTxQueue();
+
+   restore_interrupts(status);
+}
+
+//
+/// determine if queued frames are held back by the rate limit, and the time until the
+/// first of them may be sent. Frames that only wait for the controller are not counted,
+/// as the tx complete callback sends them and wakes the application
+//
+
+bool CBUSACAN2040::txPending(uint32_t &wait_us)
+{
+   bool bPending = false;
+   uint32_t status = save_and_disable_interrupts();
+
+   for (uint_fast8_t major = 0; major < tx_num_priorities; major++)
    {
-      msg.id |= 0x80000000;
+      if (_tx_queue[major].available())
+      {
+         uint32_t wait = _tx_limiter.getTimeToToken(major);
+
+         if (((wait > 0) || (acan2040 && acan2040->ok_to_send())) && (!bPending || (wait < wait_us)))
+         {
+            wait_us = wait;
+            bPending = true;
+         }
+      }
    }
 
+   restore_interrupts(status);
+
+   return bPending;
+}
+
+//
+/// transmit queued frames, highest priority first, whilst the controller has space
+/// called from the tx complete callback, or with interrupts disabled - locate in RAM
+//
+
+void __attribute__((section(".RAM"))) CBUSACAN2040::drainTxQueue(void)
+{
+   uint_fast8_t major = 0;
+
+   while (acan2040 && acan2040->ok_to_send())
+   {
+      // Find the highest priority class with a frame waiting and within its rate limit,
+      // frames over the limit are left queued until tokens accumulate
+      while ((major < tx_num_priorities) && (!_tx_queue[major].available() || !_tx_limiter.tryConsume(major)))
+      {
+         major++;
+      }
+
+      if (major >= tx_num_priorities)
+      {
+         break;
+      }
+
+      CANFrame *pFrame = _tx_queue[major].get();
+
+      if (pFrame)
+      {
+         transmitFrame(*pFrame);
+      }
+   }
+}
+
+//
+/// pass a frame to the CAN controller - locate in RAM
+//
+
+bool __attribute__((section(".RAM"))) CBUSACAN2040::transmitFrame(const CANFrame &msg)
+{
+   struct can2040_msg tx_msg;
+
    tx_msg.id = msg.id;
-   tx_msg.dlc = msg.len;
 
-   for (int_fast8_t i = 0; i < msg.len && i < 8; i++)
+   if (msg.rtr)
    {
-      tx_msg.data[i] = msg.data[i];
+      tx_msg.id |= CAN2040_ID_RTR;
    }
 
-   if (acan2040->send_message(&tx_msg))
+   if (msg.ext)
    {
-      return true;
+      tx_msg.id |= CAN2040_ID_EFF;
    }
-   else
+
+   tx_msg.dlc = msg.len;
+
+   for (int_fast8_t i = 0; i < msg.len && i < 8; i++)
    {
-      return false;
+      tx_msg.data[i] = msg.data[i];
    }
+
+   return acan2040->send_message(&tx_msg);
 }
 
 //
@@ -269,24 +418,23 @@ bool CBUSACAN2040::sendMessage(CANFrame &msg, bool rtr, bool ext, uint8_t priori
 
 void CBUSACAN2040::reset(void)
 {
-   if (rx_buffer)
-   {
-      delete rx_buffer;
-      rx_buffer = nullptr;
-   }
+   // detach the rx buffer so the ISR cannot queue frames while the controller is replaced
+   rx_buffer = nullptr;
 
-   if (rx_buffer)
-   {
-      delete tx_buffer;
-      tx_buffer = nullptr;
-   }
-   
    if (acan2040)
    {
       delete acan2040;
       acan2040 = nullptr;
    }
 
+   // discard any queued frames, begin() re-attaches the buffers
+   _rx_queue.clear();
+
+   for (auto &queue : _tx_queue)
+   {
+      queue.clear();
+   }
+
    begin();
 }
 
@@ -312,46 +460,13 @@ bool CBUSACAN2040::validateNV(const uint8_t NVindex, const uint8_t oldValue, con
 ///
 bool CBUSACAN2040::sendCANMessage(CANFrame &msg)
 {
-   struct can2040_msg tx_msg;
-
-   // caller must populate the message data
-   // this method will create the correct frame header (CAN ID and priority bits)
-   // rtr and ext default to false unless arguments are supplied - see method definition in .h
-   // priority defaults to 1011 low/medium
-
-   if (!acan2040->ok_to_send())
+   // the frame header is supplied by the caller, queue the frame by its priority
+   if (!acan2040p)
    {
       return false;
    }
 
-   //makeHeader(msg, DEFAULT_PRIORITY); // default priority unless user overrides
-
-   if (msg.rtr)
-   {
-      msg.id |= 0x40000000;
-   }
-
-   if (msg.ext)
-   {
-      msg.id |= 0x80000000;
-   }
-
-   tx_msg.id = msg.id;
-   tx_msg.dlc = msg.len;
-
-   for (int_fast8_t i = 0; i < msg.len && i < 8; i++)
-   {
-      tx_msg.data[i] = msg.data[i];
-   }
-
-   if (acan2040->send_message(&tx_msg))
-   {
-      return true;
-   }
-   else
-   {
-      return false;
-   }
+   return acan2040p->queueFrame(msg);
 }
 
 //
@@ -365,13 +480,35 @@ void CBUSACAN2040::setPins(uint8_t gpio_tx, uint8_t gpio_rx)
    _gpio_rx = gpio_rx;
 }
 
+//
+/// enable coalescing of repeated accessory events in the receive buffer, so a chattering
+/// input only queues and dispatches its latest state
+//
+
+void CBUSACAN2040::setCoalesceEvents(bool bCoalesce)
+{
+   _rx_queue.setCoalesceEvents(bCoalesce);
+}
+
+//
+/// select the action taken when a frame is received into a full receive buffer, the
+/// default overwrites the oldest frame, OVERFLOW_EVICT_LOWEST_PRIORITY keeps high
+/// priority frames in preference to low priority ones under overload
+//
+
+void CBUSACAN2040::setRxOverflowPolicy(OVERFLOW_POLICY policy)
+{
+   _rx_queue.setOverflowPolicy(policy);
+}
+
 //
 /// set the number of CAN frame receive buffers
-/// this can be tuned according to bus load and available memory
+/// deprecated, the buffers are statically allocated and sized at compile time
+/// by rx_qsize and tx_qsize, so this has no effect
 //
 
 void CBUSACAN2040::setNumBuffers(uint8_t num_rx_buffers, uint8_t num_tx_buffers)
 {
-   _num_rx_buffers = num_rx_buffers;
-   _num_tx_buffers = num_tx_buffers;
+   (void)num_rx_buffers;
+   (void)num_tx_buffers;
 }
\ No newline at end of file
@@ -44,11 +44,13 @@
 #include "CBUS.h"               // abstract base class
 #include "ACAN2040.h"           // header for CAN driver
 #include "CBUSCircularBuffer.h" // header for circular buffer of CBUS Frames
+#include "CBUSRateLimiter.h"    // header for outbound rate limiting
 
 // constants
 
-static const uint8_t tx_qsize = 8;           ///< Transmit queue size
-static const uint8_t rx_qsize = 32;          ///< Receive queue size
+static const uint8_t tx_qsize = 8;           ///< Transmit queue slots per priority class, a power of two, holds tx_qsize - 1 frames
+static const uint8_t tx_num_priorities = 4;  ///< Number of transmit priority classes, one per CBUS major priority
+static const uint8_t rx_qsize = 32;          ///< Receive queue slots, a power of two, holds rx_qsize - 1 frames
 static const uint8_t tx_pin = 12;            ///< Default CAN Tx pin number
 static const uint8_t rx_pin = 11;            ///< Default CAN Rx pin number
 static const uint32_t CANBITRATE = 125000UL; ///< 125Kb/s - fixed for CBUS
@@ -72,14 +74,24 @@ public:
    bool begin(void) override;
    bool available(void) override;
    CANFrame getNextMessage(void) override;
+   uint8_t getMessages(CANFrame *out, uint8_t max) override;
+   CBUSCircularBuffer *getRxQueue(void) override;
+   void serviceTransmit(void) override;
+   bool txPending(uint32_t &wait_us) override;
    bool sendMessage(CANFrame &msg, bool rtr = false, bool ext = false, uint8_t priority = DEFAULT_PRIORITY) override; // note default arguments
    void reset(void) override;
 
    // these methods are specific to this implementation
    // they are not declared or implemented by the base CBUS class
+   [[deprecated("buffers are sized at compile time by rx_qsize and tx_qsize")]]
    void setNumBuffers(uint8_t num_rx_buffers, uint8_t _num_tx_buffers = 2);
    void setPins(uint8_t tx_pin, uint8_t rx_pin);
+   void setCoalesceEvents(bool bCoalesce);
+   void setRxOverflowPolicy(OVERFLOW_POLICY policy);
    void notify_cb(struct can2040 *cd, uint32_t notify, struct can2040_msg *amsg);
+   bool queueFrame(const CANFrame &msg);
+   void setTxRateLimit(uint8_t major_priority, uint32_t frames_per_sec, uint32_t burst = 1);
+   uint32_t getNumTxDeferred(uint8_t major_priority);
 
    // Override base class implementation
    bool validateNV(const uint8_t NVindex, const uint8_t oldValue, const uint8_t NVvalue) override;
@@ -89,13 +101,15 @@ public:
    /// Static pointer to ACAN2040 class to manage CAN connection
    inline static ACAN2040 *acan2040 = nullptr;
    
-   CBUSCircularBuffer *tx_buffer;
    CBUSCircularBuffer *rx_buffer;
 
 private:
    void initMembers(void);
+   void drainTxQueue(void);
+   static bool transmitFrame(const CANFrame &msg);
    uint8_t _gpio_tx;
    uint8_t _gpio_rx;
-   uint8_t _num_tx_buffers;
-   uint8_t _num_rx_buffers;
+   CBUSCircularBufferT<tx_qsize> _tx_queue[tx_num_priorities];
+   CBUSCircularBufferT<rx_qsize> _rx_queue;
+   CBUSRateLimiter _tx_limiter;
 };
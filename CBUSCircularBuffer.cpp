@@ -41,6 +41,16 @@
 #include "SystemTick.h"
 
 #include <new>
+#include <cstring>
+
+#include <cbusdefs.h>
+
+/// Extract the CBUS priority from a packed CAN ID, a larger value is a lower priority
+static inline uint8_t idPriority(uint32_t id)
+{
+   // Priority is held in bits 7-10 of the 11 bit CAN ID, the upper 11 bits of an extended ID
+   return (id & CBUS_BUFFER_EXT_FLAG) ? ((id >> 25) & 0x0F) : ((id >> 7) & 0x0F);
+}
 
 ///
 /// A circular buffer class for CBUS messages
@@ -48,33 +58,78 @@
 
 /// Construct a CBUSCircularBuffer object
 
-CBUSCircularBuffer::CBUSCircularBuffer(uint8_t num_items) : m_full{false},
-                                                            m_head{0x0U},
-                                                            m_tail{0x0U},
-                                                            m_capacity{num_items},
-                                                            m_size{0x0U},
+CBUSCircularBuffer::CBUSCircularBuffer(uint8_t num_items) : m_head{0x0UL},
                                                             m_highWaterMark{0x0U},
                                                             m_puts{0x0UL},
+                                                            m_overflows{0x0UL},
+                                                            m_overwrites{0x0UL},
+                                                            m_dropsNewest{0x0UL},
+                                                            m_evictions{0x0UL},
+                                                            m_coalesced{0x0UL},
+                                                            m_tail{0x0UL},
+                                                            m_claim{0x0UL},
                                                             m_gets{0x0UL},
-                                                            m_overflows{0x0UL}
+                                                            m_dwellHistogram{},
+                                                            m_frame{},
+                                                            m_capacity{num_items},
+                                                            m_mask{0x0UL},
+                                                            m_bOwnsBuffer{true},
+                                                            m_policy{OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST},
+                                                            m_bCoalesce{false},
+                                                            m_buffer{nullptr}
 {
    // Buffer must contain at least one item
    if (num_items > 0)
    {
+      // Round storage up to the next power of two with at least one spare slot,
+      // so the producer never writes to a slot the consumer may still be reading
+      uint32_t slots = 1;
+
+      while (slots <= num_items)
+      {
+         slots <<= 1;
+      }
+
       // Allocating in constructor, so prevent exception if out of memory
-      m_buffer = new (std::nothrow) cbus_frame_buffer_t[num_items];
-   }
-   else
-   {
-      m_buffer = nullptr;
+      m_buffer = new (std::nothrow) cbus_frame_buffer_t[slots];
+
+      if (m_buffer)
+      {
+         m_mask = slots - 1;
+      }
    }
 }
 
+/// Construct a CBUSCircularBuffer object using storage provided by a derived class,
+/// num_slots must be a power of two, one slot is kept spare so num_slots - 1 items are held
+
+CBUSCircularBuffer::CBUSCircularBuffer(cbus_frame_buffer_t *storage, uint32_t num_slots) : m_head{0x0UL},
+                                                                                           m_highWaterMark{0x0U},
+                                                                                           m_puts{0x0UL},
+                                                                                           m_overflows{0x0UL},
+                                                                                           m_overwrites{0x0UL},
+                                                                                           m_dropsNewest{0x0UL},
+                                                                                           m_evictions{0x0UL},
+                                                                                           m_coalesced{0x0UL},
+                                                                                           m_tail{0x0UL},
+                                                                                           m_claim{0x0UL},
+                                                                                           m_gets{0x0UL},
+                                                                                           m_dwellHistogram{},
+                                                                                           m_frame{},
+                                                                                           m_capacity{static_cast<uint8_t>(num_slots - 1)},
+                                                                                           m_mask{num_slots - 1},
+                                                                                           m_bOwnsBuffer{false},
+                                                                                           m_policy{OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST},
+                                                                                           m_bCoalesce{false},
+                                                                                           m_buffer{storage}
+{
+}
+
 /// Destroy a CBUSCircularBuffer object instance
 
 CBUSCircularBuffer::~CBUSCircularBuffer()
 {
-   if (m_buffer)
+   if (m_buffer && m_bOwnsBuffer)
    {
       delete[] m_buffer;
    }
@@ -88,12 +143,15 @@ CBUSCircularBuffer::~CBUSCircularBuffer()
 ///
 bool CBUSCircularBuffer::available()
 {
-   return (m_size > 0);
+   return (m_head.load(std::memory_order_acquire) != m_tail.load(std::memory_order_relaxed));
 }
 
 ///
-/// @brief Store an item to the buffer - overwrite oldest item if buffer is full,
-/// only called from an interrupt context so we don't need to worry about subsequent interrupts
+/// @brief Store an item to the buffer, if the buffer is full the overflow policy selects
+/// the item that is discarded.
+/// This is the producer side of the ring, it writes the head index, and only moves the tail
+/// past an item the consumer has not claimed, so may be called from an interrupt context
+/// without the consumer having to disable interrupts
 ///
 /// @param item CANFrame to store in the circular buffer
 ///
@@ -104,29 +162,49 @@ void __attribute__((section(".RAM"))) CBUSCircularBuffer::put(const CANFrame &it
       return;
    }
 
-   // Copy the frame into the item buffer and set the buffer insertion timestamp
-   m_buffer[m_head]._item = item;
-   m_buffer[m_head]._item_insert_time = SystemTick::GetMicros();
+   uint32_t head = m_head.load(std::memory_order_relaxed);
 
-   // if the buffer is full, this put will overwrite the oldest item
+   // a repeated event replaces the queued frame, so does not need a slot
+   if (m_bCoalesce && coalesce(item, head))
+   {
+      ++m_coalesced;
+      return;
+   }
 
-   if (m_full)
+   uint32_t tail = m_tail.load(std::memory_order_acquire);
+   uint32_t used = head - tail;
+   uint32_t id = (item.id & CBUS_BUFFER_ID_MASK) | (item.ext ? CBUS_BUFFER_EXT_FLAG : 0x0UL) | (item.rtr ? CBUS_BUFFER_RTR_FLAG : 0x0UL);
+
+   if (used >= m_capacity)
    {
-      m_tail = (m_tail + 1) % m_capacity;
       ++m_overflows;
+
+      if (!makeRoom(id, tail, head))
+      {
+         return;
+      }
+   }
+   else if (used + 1 > m_highWaterMark)
+   {
+      m_highWaterMark = used + 1;
    }
 
-   m_head = (m_head + 1) % m_capacity;
-   m_full = m_head == m_tail;
-   m_size = size();
-   m_highWaterMark = (m_size > m_highWaterMark) ? m_size : m_highWaterMark;
+   // Pack the frame into the item buffer along with the buffer insertion timestamp
+   cbus_frame_buffer_t &slot = m_buffer[head & m_mask];
+   slot._id = id;
+   slot._time_len = (SystemTick::GetMicros() & CBUS_BUFFER_TIME_MASK) | (static_cast<uint32_t>(item.len) << CBUS_BUFFER_LEN_SHIFT);
+   memcpy(slot._data, item.data, sizeof(slot._data));
+
    ++m_puts;
+
+   // Publish the item to the consumer
+   m_head.store(head + 1, std::memory_order_release);
 }
 
 ///
 /// @brief Retrieve the next item available in the circular buffer
 ///
-/// @return CANFrame* Pointer to the next available item in the circular buffer
+/// @return CANFrame* Pointer to a copy of the next available item, valid until the next get or peek
 ///
 CANFrame *CBUSCircularBuffer::get()
 {
@@ -140,25 +218,55 @@ CANFrame *CBUSCircularBuffer::get()
 
    // should always call ::available first to avoid returning null pointer
 
-   // protect against changes to the buffer by suspending interrupts
+   uint8_t count;
+   uint32_t tail = acquire(1, count);
 
-   if (m_size > 0)
+   if (count > 0)
    {
-      p = &m_buffer[m_tail]._item;
-      m_full = false;
-      m_tail = (m_tail + 1) % m_capacity;
-      m_size = size();
-      ++m_gets;
+      unpack(m_buffer[tail & m_mask], m_frame);
+      p = &m_frame;
+
+      // Release the slot back to the producer
+      release(tail, count);
    }
 
    return p;
 }
 
+///
+/// @brief Retrieve up to max items from the circular buffer in a single call
+///
+/// @param out Array to receive copies of the items, must hold at least max items
+/// @param max Maximum number of items to retrieve
+/// @return uint8_t Number of items copied into out
+///
+uint8_t CBUSCircularBuffer::getMessages(CANFrame *out, uint8_t max)
+{
+   uint8_t count = 0;
+
+   if (!m_buffer)
+   {
+      return count;
+   }
+
+   uint32_t tail = acquire(max, count);
+
+   for (uint8_t i = 0; i < count; i++)
+   {
+      unpack(m_buffer[(tail + i) & m_mask], out[i]);
+   }
+
+   // Release all copied slots back to the producer at once
+   release(tail, count);
+
+   return count;
+}
+
 ///
 /// @brief Get the insert time of the current buffer tail item
 /// must be called before the item is removed by CBUSCircularBuffer::get
 ///
-/// @return uint32_t Insertion time, in microseconds since boot
+/// @return uint32_t Insertion time, in microseconds since boot masked by CBUS_BUFFER_TIME_MASK
 ///
 uint32_t CBUSCircularBuffer::getInsertTime()
 {
@@ -167,68 +275,382 @@ uint32_t CBUSCircularBuffer::getInsertTime()
       return 0x0UL;
    }
 
-   return (m_buffer[m_tail]._item_insert_time);
+   return (m_buffer[m_tail.load(std::memory_order_acquire) & m_mask]._time_len & CBUS_BUFFER_TIME_MASK);
 }
 
 ///
 /// @brief Peek at the next item in the circular buffer without removing it
 ///
-/// @return CANFrame* Pointer to the next item in the circular buffer
+/// @return CANFrame* Pointer to a copy of the next item, valid until the next get or peek
 ///
 CANFrame *CBUSCircularBuffer::peek(void)
 {
    // You should always call ::available first to avoid this
-   if (!m_buffer || m_size == 0)
+   if (!m_buffer || !available())
    {
       return nullptr;
    }
 
-   return (&m_buffer[m_tail]._item);
+   uint32_t held = m_claim.load(std::memory_order_relaxed);
+   uint8_t count;
+   uint32_t tail = acquire(1, count);
+
+   if (count == 0)
+   {
+      return nullptr;
+   }
+
+   unpack(m_buffer[tail & m_mask], m_frame);
+
+   // A copy is returned, so unless already held the item is only claimed whilst it is copied
+   if (static_cast<int32_t>(held - tail) <= 0)
+   {
+      m_claim.store(tail);
+   }
+
+   return &m_frame;
 }
 
 ///
-/// @brief Clear all items in the circular buffer
+/// @brief Clear all items in the circular buffer, called by the consumer
 ///
 void CBUSCircularBuffer::clear(void)
 {
-   m_head = 0;
-   m_tail = 0;
-   m_full = false;
-   m_size = 0;
+   m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
 }
 
 ///
-/// @brief Recalculate the number of items in the buffer
+/// @brief Calculate the number of items in the buffer
 ///
 /// @return uint8_t Number of items currently in the circular buffer
 ///
 uint8_t CBUSCircularBuffer::size(void)
 {
-   uint8_t size = m_capacity;
+   return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
 
-   if (!m_full)
+///
+/// @brief Determines if the circular buffer is empty
+///
+/// @return true if the circular buffer is empty
+/// @return false if the circular buffer is not empty
+///
+bool CBUSCircularBuffer::empty(void)
+{
+   return !available();
+}
+
+///
+/// @brief Retrieve the number of items discarded by an overflow policy
+///
+/// @param policy Overflow policy, OVERFLOW_OVERWRITE_OLDEST counts overwritten items,
+/// OVERFLOW_DROP_NEWEST counts new items discarded, which includes those discarded when
+/// every slot is held by the consumer, OVERFLOW_EVICT_LOWEST_PRIORITY counts evicted items
+/// @return uint32_t number of items discarded
+///
+uint32_t CBUSCircularBuffer::getNumDrops(OVERFLOW_POLICY policy)
+{
+   switch (policy)
    {
-      if (m_head >= m_tail)
+   case OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST:
+      return m_overwrites;
+
+   case OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST:
+      return m_dropsNewest;
+
+   case OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY:
+      return m_evictions;
+
+   default:
+      return 0x0UL;
+   }
+}
+
+///
+/// @brief Retrieve the number of items in a bucket of the dwell time histogram, the dwell
+/// time is the time from an item being put to the buffer, until it is retrieved
+///
+/// @param bucket Histogram bucket, see CBUS_DWELL_BUCKETS
+/// @return uint32_t number of items retrieved with a dwell time in the bucket range
+///
+uint32_t CBUSCircularBuffer::getDwellCount(uint8_t bucket)
+{
+   return (bucket < CBUS_DWELL_BUCKETS) ? m_dwellHistogram[bucket] : 0x0UL;
+}
+
+///
+/// @brief Clear the dwell time histogram, called by the consumer
+///
+void CBUSCircularBuffer::resetDwellHistogram(void)
+{
+   for (auto &count : m_dwellHistogram)
+   {
+      count = 0x0UL;
+   }
+}
+
+///
+/// @brief Add the dwell time of items being released by the consumer to the histogram
+///
+/// @param tail Tail index of the first item being released
+/// @param count Number of items being released
+///
+void CBUSCircularBuffer::recordDwell(uint32_t tail, uint8_t count)
+{
+   if (count == 0)
+   {
+      return;
+   }
+
+   uint32_t now = SystemTick::GetMicros();
+
+   for (uint32_t i = tail; i != tail + count; i++)
+   {
+      uint32_t dwell = (now - m_buffer[i & m_mask]._time_len) & CBUS_BUFFER_TIME_MASK;
+
+      // bucket is the number of significant bits in the dwell time
+      uint8_t bucket = (dwell == 0) ? 0 : (32 - __builtin_clz(dwell));
+
+      if (bucket >= CBUS_DWELL_BUCKETS)
       {
-         size = m_head - m_tail;
+         bucket = CBUS_DWELL_BUCKETS - 1;
       }
-      else
+
+      ++m_dwellHistogram[bucket];
+   }
+}
+
+///
+/// @brief Make room for a new item when the buffer is full, as selected by the overflow policy.
+/// Items claimed by the consumer are never discarded.  The oldest unclaimed item is discarded
+/// by moving the tail past it, or when the consumer has claimed older items, by moving the
+/// newer items down one slot over it, which relies on put() and the consumer running on the
+/// same core, as the ISR and main loop do
+///
+/// @param id Packed CAN ID and flags of the new item
+/// @param tail Tail index read by put
+/// @param head Head index the new item is to be written to, moved back one slot if the
+/// newer items were moved down
+/// @return true the new item may be written at head
+/// @return false the new item is discarded
+///
+bool __attribute__((section(".RAM"))) CBUSCircularBuffer::makeRoom(uint32_t id, uint32_t tail, uint32_t &head)
+{
+   uint32_t first = m_claim.load();
+
+   if (static_cast<int32_t>(first - tail) < 0)
+   {
+      first = tail;
+   }
+
+   // Either the policy is to drop the new item, or every item is held by the consumer
+   if ((m_policy == OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST) || (static_cast<int32_t>(head - first) <= 0))
+   {
+      ++m_dropsNewest;
+      return false;
+   }
+
+   uint32_t victim = first;
+
+   if (m_policy == OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY)
+   {
+      uint8_t lowest = idPriority(m_buffer[first & m_mask]._id);
+
+      for (uint32_t i = first + 1; i != head; i++)
       {
-         size = m_capacity + m_head - m_tail;
+         uint8_t priority = idPriority(m_buffer[i & m_mask]._id);
+
+         if (priority > lowest)
+         {
+            lowest = priority;
+            victim = i;
+         }
       }
+
+      ++m_evictions;
+
+      // The new item is the oldest of the lowest priority items only if no queued item is as low
+      if (idPriority(id) > lowest)
+      {
+         return false;
+      }
+   }
+   else
+   {
+      ++m_overwrites;
    }
 
-   m_size = size;
-   return m_size;
+   discard(victim, tail, head);
+   return true;
 }
 
 ///
-/// @brief Determines if the circular buffer is empty
+/// @brief Discard an unclaimed item to free a slot for a new item
 ///
-/// @return true if the circular buffer is empty
-/// @return false if the circular buffer is not empty
+/// @param victim Index of the item to discard
+/// @param tail Tail index read by put
+/// @param head Head index the new item is to be written to, moved back one slot if the
+/// newer items were moved down
 ///
-bool CBUSCircularBuffer::empty(void)
+void __attribute__((section(".RAM"))) CBUSCircularBuffer::discard(uint32_t victim, uint32_t tail, uint32_t &head)
+{
+   if (victim == tail)
+   {
+      // The consumer may have released the oldest item since put read the tail,
+      // either way its slot is free, so a failed exchange needs no retry
+      m_tail.compare_exchange_strong(tail, tail + 1);
+   }
+   else
+   {
+      for (uint32_t i = victim; i + 1 != head; i++)
+      {
+         m_buffer[i & m_mask] = m_buffer[(i + 1) & m_mask];
+      }
+
+      --head;
+   }
+}
+
+///
+/// @brief Claim up to max of the oldest items before the consumer reads them, the producer
+/// does not discard, coalesce into or rearrange claimed items.  The tail is read again once
+/// the claim is visible, in case the producer discarded the oldest item in the meantime
+///
+/// @param max Maximum number of items to claim
+/// @param count Set to the number of items claimed
+/// @return uint32_t Tail index of the first item claimed
+///
+uint32_t CBUSCircularBuffer::acquire(uint8_t max, uint8_t &count)
+{
+   uint32_t tail;
+
+   do
+   {
+      tail = m_tail.load(std::memory_order_acquire);
+
+      uint32_t used = m_head.load(std::memory_order_acquire) - tail;
+
+      count = (used > max) ? max : used;
+      claim(tail + count);
+   } while (m_tail.load() != tail);
+
+   return tail;
+}
+
+///
+/// @brief Release items claimed by CBUSCircularBuffer::acquire back to the producer
+///
+/// @param tail Tail index of the first item to release
+/// @param count Number of items to release
+///
+void CBUSCircularBuffer::release(uint32_t tail, uint8_t count)
+{
+   if (count > 0)
+   {
+      m_gets += count;
+      recordDwell(tail, count);
+
+      m_tail.store(tail + count, std::memory_order_release);
+   }
+}
+
+///
+/// @brief Unpack a buffer item into a CANFrame
+///
+/// @param slot Packed buffer item
+/// @param frame CANFrame to receive the unpacked item
+///
+void CBUSCircularBuffer::unpack(const cbus_frame_buffer_t &slot, CANFrame &frame)
+{
+   frame.id = slot._id & CBUS_BUFFER_ID_MASK;
+   frame.ext = (slot._id & CBUS_BUFFER_EXT_FLAG) != 0;
+   frame.rtr = (slot._id & CBUS_BUFFER_RTR_FLAG) != 0;
+   frame.len = slot._time_len >> CBUS_BUFFER_LEN_SHIFT;
+   memcpy(frame.data, slot._data, sizeof(frame.data));
+}
+
+///
+/// @brief Mark items up to end as being read by the consumer, the producer does not coalesce
+/// new items into them. Must be called before the items are read
+///
+/// @param end Index one beyond the last item to be read
+///
+void CBUSCircularBuffer::claim(uint32_t end)
 {
-   return (!m_full && (m_head == m_tail));
+   if (static_cast<int32_t>(end - m_claim.load(std::memory_order_relaxed)) > 0)
+   {
+      m_claim.store(end);
+   }
+}
+
+///
+/// @brief Replace a queued accessory event frame with a new frame for the same event,
+/// so the latest state of the event is delivered without taking another slot.
+/// Only items not yet claimed by the consumer are candidates, this relies on put()
+/// and the consumer running on the same core, as the ISR and main loop do
+///
+/// @param item New frame
+/// @param head Current head index
+/// @return true the new frame replaced a queued frame
+/// @return false the new frame must be queued
+///
+bool __attribute__((section(".RAM"))) CBUSCircularBuffer::coalesce(const CANFrame &item, uint32_t head)
+{
+   // only accessory ON/OFF events, of any length, are coalesced
+   switch (item.data[0])
+   {
+   case OPC_ACON:
+   case OPC_ACOF:
+   case OPC_ASON:
+   case OPC_ASOF:
+   case OPC_ACON1:
+   case OPC_ACOF1:
+   case OPC_ASON1:
+   case OPC_ASOF1:
+   case OPC_ACON2:
+   case OPC_ACOF2:
+   case OPC_ASON2:
+   case OPC_ASOF2:
+   case OPC_ACON3:
+   case OPC_ACOF3:
+   case OPC_ASON3:
+   case OPC_ASOF3:
+      break;
+
+   default:
+      return false;
+   }
+
+   if (item.ext || item.rtr || (item.len < 5))
+   {
+      return false;
+   }
+
+   uint32_t tail = m_tail.load(std::memory_order_acquire);
+   uint32_t first = m_claim.load(std::memory_order_acquire);
+
+   if (static_cast<int32_t>(first - tail) < 0)
+   {
+      first = tail;
+   }
+
+   for (uint32_t i = first; static_cast<int32_t>(head - i) > 0; i++)
+   {
+      cbus_frame_buffer_t &slot = m_buffer[i & m_mask];
+
+      // ON and OFF opcodes of an event differ only in bit 0
+      if (!(slot._id & (CBUS_BUFFER_EXT_FLAG | CBUS_BUFFER_RTR_FLAG)) &&
+          ((slot._time_len >> CBUS_BUFFER_LEN_SHIFT) == item.len) &&
+          ((slot._data[0] | 0x01) == (item.data[0] | 0x01)) &&
+          (memcmp(&slot._data[1], &item.data[1], 4) == 0))
+      {
+         // Replace the frame, keeping the original insertion time
+         slot._id = item.id & CBUS_BUFFER_ID_MASK;
+         slot._time_len = (slot._time_len & CBUS_BUFFER_TIME_MASK) | (static_cast<uint32_t>(item.len) << CBUS_BUFFER_LEN_SHIFT);
+         memcpy(slot._data, item.data, sizeof(slot._data));
+         return true;
+      }
+   }
+
+   return false;
 }
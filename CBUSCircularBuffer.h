@@ -40,6 +40,7 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
 
 //
 /// Class to hold a CAN/CBUS frame
@@ -60,16 +61,61 @@ public:
    uint8_t data[8] = {};
 };
 
-/// A buffer item type for holding CAN/CBUS frames in the circular buffer
+/// Mask for the CAN ID held in cbus_frame_buffer_t::_id
+constexpr uint32_t CBUS_BUFFER_ID_MASK = 0x1FFFFFFFUL;
+/// EXT flag held in cbus_frame_buffer_t::_id
+constexpr uint32_t CBUS_BUFFER_EXT_FLAG = 0x20000000UL;
+/// RTR flag held in cbus_frame_buffer_t::_id
+constexpr uint32_t CBUS_BUFFER_RTR_FLAG = 0x40000000UL;
+/// Mask for the insertion time held in cbus_frame_buffer_t::_time_len, wraps every 268 seconds
+constexpr uint32_t CBUS_BUFFER_TIME_MASK = 0x0FFFFFFFUL;
+/// Shift of the frame length held in cbus_frame_buffer_t::_time_len
+constexpr uint8_t CBUS_BUFFER_LEN_SHIFT = 28;
+
+/// Number of buckets in the dwell time histogram, bucket 0 counts a dwell of 0us, bucket n
+/// counts a dwell of 2^(n-1) to 2^n - 1 us, the last bucket also counts all longer dwells
+constexpr uint8_t CBUS_DWELL_BUCKETS = 20;
+
+/// A packed buffer item type for holding CAN/CBUS frames in the circular buffer,
+/// the flags and length are folded into spare bits so each slot is four words
 
 typedef struct
 {
-   uint32_t _item_insert_time;
-   CANFrame _item;
+   uint32_t _id;       ///< CAN ID, EXT and RTR flags
+   uint32_t _time_len; ///< Insertion time in microseconds and frame length
+   uint8_t _data[8];   ///< CAN Frame raw data
 } cbus_frame_buffer_t;
 
+static_assert(sizeof(cbus_frame_buffer_t) == 16, "cbus_frame_buffer_t must pack into four words");
+
+/// Action taken when an item is put to a full circular buffer
+enum class OVERFLOW_POLICY : uint8_t
+{
+   OVERFLOW_OVERWRITE_OLDEST,      ///< Discard the oldest item to make room for the new item
+   OVERFLOW_DROP_NEWEST,           ///< Discard the new item
+   OVERFLOW_EVICT_LOWEST_PRIORITY, ///< Discard the oldest item with the lowest CBUS priority, which may be the new item
+   OVERFLOW_NUM_POLICIES           ///< Number of overflow policies
+};
+
 //
 /// A circular buffer class for holding CAN/CBUS Messages
+///
+/// The buffer is a single-producer / single-consumer ring, put() may be called from an
+/// interrupt context whilst the remaining methods are called from the main loop.
+/// The producer owns the head index, the consumer owns the tail index and claims items
+/// before reading them, so neither side needs to disable interrupts.  When the buffer is
+/// full, the producer discards the oldest unclaimed item, moving the tail with a
+/// compare-and-swap if that item is the oldest, so the most recent items are retained.
+/// Storage is rounded up to a power of two larger than the requested capacity, so indexes
+/// are masked rather than wrapped with a modulo, and the producer never writes to the slot
+/// of an item the consumer may still be reading.
+///
+/// This is not a pure SPSC split, so put() must be called on the same core as the
+/// consumer, e.g. from an interrupt handler interrupting the main loop.  Overwriting the
+/// oldest item only moves the tail with a compare-and-swap, but when the consumer has
+/// claimed older items, eviction, coalescing and overwriting rewrite unclaimed slots that
+/// the consumer may be about to claim, which is only safe whilst the consumer cannot run.
+/// The buffer must not be shared between cores, CBUSMulticore uses CBUSCoreQueue for that.
 //
 
 class CBUSCircularBuffer
@@ -86,10 +132,43 @@ public:
    void put(const CANFrame &cf);
    CANFrame *peek(void);
    CANFrame *get(void);
+   uint8_t getMessages(CANFrame *out, uint8_t max);
    uint32_t getInsertTime(void);
    void clear(void);
    uint8_t size(void);
    bool empty(void);
+   uint32_t getNumDrops(OVERFLOW_POLICY policy);
+   uint32_t getDwellCount(uint8_t bucket);
+   void resetDwellHistogram(void);
+
+   ///
+   /// @brief Select the action taken when an item is put to a full circular buffer
+   ///
+   /// @param policy Overflow policy to apply from the next put
+   ///
+   inline void setOverflowPolicy(OVERFLOW_POLICY policy) {m_policy = policy;}
+
+   ///
+   /// @brief Get the action taken when an item is put to a full circular buffer
+   ///
+   /// @return OVERFLOW_POLICY Current overflow policy
+   ///
+   inline OVERFLOW_POLICY getOverflowPolicy(void) {return m_policy;}
+
+   ///
+   /// @brief Enable coalescing of accessory event frames, a new ON/OFF event frame for the same
+   /// NN/EN as a frame still queued replaces the queued frame rather than taking a new slot
+   ///
+   /// @param bCoalesce true to enable coalescing
+   ///
+   inline void setCoalesceEvents(bool bCoalesce) {m_bCoalesce = bCoalesce;}
+
+   ///
+   /// @brief Retrieve the number of event frames coalesced with a queued frame
+   ///
+   /// @return uint32_t number of coalesced event frames
+   ///
+   inline uint32_t getNumCoalesced(void) {return m_coalesced;}
 
    ///
    /// @brief Determine if the circular buffer is full
@@ -97,14 +176,14 @@ public:
    /// @return true if the circular buffer is full
    /// @return false if the circular buffer is not full
    ///
-   inline bool full(void) {return m_full;}
+   inline bool full(void) {return (m_capacity > 0) && (size() == m_capacity);}
 
    ///
    /// @brief Determines the number of free entries left in the circular buffer
    ///
    /// @return uint8_t number of entries left in the circular buffer
    ///
-   inline uint8_t getNumFreeSlots(void) {return (m_capacity - m_size);}
+   inline uint8_t getNumFreeSlots(void) {return (m_capacity - size());}
 
    ///
    /// @brief Retrieve the number of insertions into the circular buffer
@@ -134,15 +213,63 @@ public:
    ///
    inline uint32_t getNumOverflows(void) {return m_overflows;}
 
+protected:
+   CBUSCircularBuffer(cbus_frame_buffer_t *storage, uint32_t num_slots);
+
 private:
-   bool m_full;
-   uint8_t m_head;
-   uint8_t m_tail;
-   uint8_t m_capacity;
-   uint8_t m_size;
+   bool makeRoom(uint32_t id, uint32_t tail, uint32_t &head);
+   void discard(uint32_t victim, uint32_t tail, uint32_t &head);
+   uint32_t acquire(uint8_t max, uint8_t &count);
+   void release(uint32_t tail, uint8_t count);
+   void recordDwell(uint32_t tail, uint8_t count);
+   void claim(uint32_t end);
+   bool coalesce(const CANFrame &item, uint32_t head);
+   static void unpack(const cbus_frame_buffer_t &slot, CANFrame &frame);
+
+   // Written by the producer (put) only
+   std::atomic<uint32_t> m_head;
    uint8_t m_highWaterMark;
    uint32_t m_puts;
-   uint32_t m_gets;
    uint32_t m_overflows;
+   uint32_t m_overwrites;
+   uint32_t m_dropsNewest;
+   uint32_t m_evictions;
+   uint32_t m_coalesced;
+
+   // Written by the consumer (get, peek, clear), the producer only moves the tail past an unclaimed item
+   std::atomic<uint32_t> m_tail;
+   std::atomic<uint32_t> m_claim;
+   uint32_t m_gets;
+   uint32_t m_dwellHistogram[CBUS_DWELL_BUCKETS];
+   CANFrame m_frame;
+
+   // Fixed at construction
+   uint8_t m_capacity;
+   uint32_t m_mask;
+   bool m_bOwnsBuffer;
+   OVERFLOW_POLICY m_policy;
+   bool m_bCoalesce;
    cbus_frame_buffer_t *m_buffer;
 };
+
+//
+/// A circular buffer of CAN/CBUS Messages with statically allocated storage
+///
+/// N is the number of storage slots and must be a power of two, one slot is kept spare
+/// so the producer never writes to a slot the consumer may still be reading, so the
+/// buffer holds up to N - 1 items.  No memory is
+/// allocated from the heap, so the footprint of the buffer is fixed at compile time.
+//
+
+template <uint32_t N>
+class CBUSCircularBufferT : public CBUSCircularBuffer
+{
+   static_assert((N >= 2) && ((N & (N - 1)) == 0), "CBUSCircularBufferT size must be a power of two");
+   static_assert(N <= 256, "CBUSCircularBufferT size must not exceed 256 slots");
+
+public:
+   CBUSCircularBufferT() : CBUSCircularBuffer(m_storage, N) {}
+
+private:
+   cbus_frame_buffer_t m_storage[N];
+};
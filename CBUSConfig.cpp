@@ -74,13 +74,13 @@ constexpr uint8_t DEFAULT_CANID = 1U; ///< Default CAN ID (for SLiM), likely to
 constexpr uint8_t DEFAULT_NN = 0U;    ///< Default Node Number, modules should start with a node number of zero
 
 /// Memory offset of flash in global memory map (flash is memory mapped)
-uintptr_t FLASH_BASE = (XIP_BASE + PICO_FLASH_SIZE_BYTES) - FLASH_SECTOR_SIZE;
+uintptr_t FLASH_BASE = (XIP_BASE + PICO_FLASH_SIZE_BYTES) - FLASH_STORAGE_SIZE;
 
 /// Offset into flash where our data is located (for write)
-constexpr uint32_t FLASH_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
+constexpr uint32_t FLASH_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_STORAGE_SIZE;
 
-/// Size of our image data is 4KiB or one sectors
-constexpr uint32_t FLASH_SIZE = FLASH_SECTOR_SIZE;
+/// Size of our image data, CBUS_FLASH_SECTORS sectors of 4KiB
+constexpr uint32_t FLASH_SIZE = FLASH_STORAGE_SIZE;
 
 /// Delay for an external EEPROM to complete a write request
 constexpr uint32_t EEPROM_WRITE_DELAY = 4;
@@ -111,17 +111,36 @@ CBUSConfig::CBUSConfig() : EE_EVENTS_START{0x0UL},
                            EE_NVS_START{0x0UL},
                            EE_NUM_NVS{0x0U},
                            m_intrStatus{0x0UL},
+                           m_bMulticoreLockout{false},
                            m_eepromType{EEPROM_TYPE::EEPROM_USES_FLASH},
                            m_externalAddress{EEPROM_I2C_ADDR},
                            m_i2cBus{i2c_default},
                            m_evhashtbl{nullptr},
                            m_bHashCollisions{false},
-                           m_bFlashModified{false},
-                           m_bFlashZeroToOne{false},
+                           m_flashModified{0x0UL},
+                           m_flashZeroToOne{0x0UL},
                            m_flashBuf{},
                            m_canId{0x0U},
                            m_bFLiM{false},
-                           m_nodeNum{0x0UL}
+                           m_nodeNum{0x0UL},
+                           m_evIndex{nullptr},
+                           m_evIndexMask{0x0U},
+                           m_evIndexBits{0x0U},
+                           m_evKeys{nullptr},
+                           m_evFreeMap{nullptr},
+                           m_hashCounts{},
+                           m_numEvents{0x0U},
+                           m_numHashCollisions{0x0U},
+                           m_evFilter{nullptr},
+                           m_evFilterMask{0x0U},
+                           m_evFilterStale{0x0U},
+                           m_shortBits{nullptr},
+                           m_shortRank{nullptr},
+                           m_shortSlots{nullptr},
+                           m_numShortEvents{0x0U},
+                           m_evMirror{nullptr},
+                           m_evMirrorReq{0x0U},
+                           m_evMirrorEVs{0x0U}
 {
 }
 
@@ -137,30 +156,97 @@ CBUSConfig::~CBUSConfig()
       delete[] m_evhashtbl;
       m_evhashtbl = nullptr;
    }
+
+   // Delete any allocated event index
+   if (m_evIndex)
+   {
+      delete[] m_evIndex;
+      m_evIndex = nullptr;
+   }
+
+   // Delete any allocated event key cache
+   if (m_evKeys)
+   {
+      delete[] m_evKeys;
+      m_evKeys = nullptr;
+   }
+
+   // Delete any allocated free slot map
+   if (m_evFreeMap)
+   {
+      delete[] m_evFreeMap;
+      m_evFreeMap = nullptr;
+   }
+
+   // Delete any allocated prefilter
+   if (m_evFilter)
+   {
+      delete[] m_evFilter;
+      m_evFilter = nullptr;
+   }
+
+   // Delete any allocated short event table
+   setShortEventTable(false);
+
+   // Delete any allocated event variable mirror
+   setEVMirror(0);
 }
 
 ///
-/// @brief Disable interrupts and pause the second core
+/// @brief Disable interrupts
 ///
 void CBUSConfig::disableIRQs()
 {
-   /// Pause the second core - @todo need flag if single core
-   // multicore_lockout_start_blocking();
-
    // Disable IRQs
    m_intrStatus = save_and_disable_interrupts();
 }
 
 ///
-/// @brief Enable interrups and re-enable the second core
+/// @brief Enable interrups
 ///
 void CBUSConfig::enableIRQs()
 {
    // Enable IRQs
    restore_interrupts(m_intrStatus);
+}
+
+///
+/// @brief Pause the other core, then disable interrupts, before erasing or programming flash,
+/// as no code may execute from flash until the operation completes
+///
+void CBUSConfig::beginFlashWrite()
+{
+   // Pause the other core first, it cannot respond once this core's interrupts are disabled
+   if (m_bMulticoreLockout)
+   {
+      multicore_lockout_start_blocking();
+   }
+
+   disableIRQs();
+}
+
+///
+/// @brief Enable interrupts and resume the other core after erasing or programming flash
+///
+void CBUSConfig::endFlashWrite()
+{
+   enableIRQs();
 
-   /// Resume the second core - @todo need flag if single core
-   // multicore_lockout_end_blocking();
+   if (m_bMulticoreLockout)
+   {
+      multicore_lockout_end_blocking();
+   }
+}
+
+///
+/// @brief Pause the other core whilst flash is erased or programmed, the other
+/// core must have called multicore_lockout_victim_init()
+///
+/// @param bLockout true if both cores are running
+///
+void CBUSConfig::setMulticoreLockout(bool bLockout)
+{
+   m_bMulticoreLockout = bLockout;
 }
 
 ///
@@ -174,7 +260,7 @@ void CBUSConfig::begin()
    {
       // Read flash into memory cache - flash is memory mapped
       // load the page into the flash buffer - flash is memory mapped
-      memcpy(m_flashBuf, reinterpret_cast<void *>(FLASH_BASE), FLASH_SECTOR_SIZE);
+      memcpy(m_flashBuf, reinterpret_cast<void *>(FLASH_BASE), FLASH_STORAGE_SIZE);
    }
 
    if (m_eepromType == EEPROM_TYPE::EEPROM_EXTERNAL_I2C)
@@ -292,107 +378,113 @@ void CBUSConfig::setNodeNum(uint32_t nn)
 }
 
 ///
-/// @brief Lookup an event by node number and event number, using the hash table
+/// @brief Lookup an event by node number and event number, using the event index
 ///
 /// @param nn Node Number
 /// @param en Event Number
-/// @return uint8_t Index of the event, EE_MAX_EVENTS if the event is not found
+/// @return uint16_t Index of the event, EE_MAX_EVENTS if the event is not found
 ///
-uint8_t CBUSConfig::findExistingEvent(uint16_t nn, uint16_t en)
+uint16_t CBUSConfig::findExistingEvent(uint16_t nn, uint16_t en)
 {
-   uint8_t tmphash, i, j, matches;
-   bool confirmed = false;
+   // Short events are looked up directly by event number, when the table is enabled
+   if (nn == 0 && m_shortBits != nullptr)
+   {
+      if ((m_shortBits[en / 64U] & (1ULL << (en % 64U))) == 0)
+      {
+         return EE_MAX_EVENTS;
+      }
 
-   EVENT_INFO_t evInfo {.nodeNumber=nn, .eventNumber=en};
+      return m_shortSlots[shortPosition(en)];
+   }
 
-   // calc the hash of the incoming event to match
-   tmphash = makeHash(evInfo);
+   return indexFind(makeEventKey(nn, en));
+}
 
-   for (i = 0; i < EE_MAX_EVENTS; i++)
+///
+/// @brief Cheap check against the prefilter of learnt events, used to reject events this node
+///        has not learnt before a full lookup.  May report a false positive, never a false negative
+///
+/// @param nn Node Number
+/// @param en Event Number
+/// @return true The event may have been learnt, confirm with findExistingEvent()
+/// @return false The event has definitely not been learnt
+///
+bool CBUSConfig::mayHaveEvent(uint16_t nn, uint16_t en)
+{
+   // The short event bitmap is exact
+   if (nn == 0 && m_shortBits != nullptr)
    {
-      if (m_evhashtbl[i] == tmphash)
-      {
-         if (!m_bHashCollisions)
-         {
-            // NN + EN hash matches and there are no hash collisions in the hash table
-         }
-         else
-         {
-            // there is a potential hash collision, so we have to check the slower way
-            // first, check if this hash appears in the table more than once
-            for (j = 0, matches = 0; j < EE_MAX_EVENTS; j++)
-            {
-               if (m_evhashtbl[j] == tmphash)
-               {
-                  ++matches;
-               }
-            }
-
-            if (matches > 1)
-            {
-               // one or more collisions for this hash exist, so check the very slow way
-               for (i = 0; i < EE_MAX_EVENTS; i++)
-               {
-                  if (m_evhashtbl[i] == tmphash)
-                  {
-                     // check the EEPROM for a match with the incoming NN and EN
-                     EVENT_INFO_t evInfo;
-                     readEvent(i, evInfo);
-                     if ((evInfo.nodeNumber == nn) && (evInfo.eventNumber == en))
-                     {
-                        // the stored NN and EN match this event, so no further checking is required
-                        confirmed = true;
-                        break;
-                     }
-                  }
-               }
-            }
-            else
-            {
-               // no collisions for this specific hash, so no further checking is required
-               break;
-            }
-         }
+      return (m_shortBits[en / 64U] & (1ULL << (en % 64U))) != 0;
+   }
 
-         break;
-      }
+   if (m_evFilter == nullptr)
+   {
+      return true;
    }
 
-   // finally, there may be a collision with an event that we haven't seen before
-   // so we still need to check the candidate match to be certain, if we haven't done so already
+   uint32_t hash = filterMix(makeEventKey(nn, en));
+   uint32_t bit1 = hash & m_evFilterMask;
+   uint32_t bit2 = ((hash >> 16) | (hash << 16)) & m_evFilterMask;
+
+   return ((m_evFilter[bit1 / 32U] & (1UL << (bit1 % 32U))) != 0) &&
+          ((m_evFilter[bit2 / 32U] & (1UL << (bit2 % 32U))) != 0);
+}
+
+///
+/// @brief Find first empty slot in the Event Table
+///
+/// @return uint16_t index of the event slot, or EE_MAX_EVENTS if no free slot found
+///
+uint16_t CBUSConfig::findEventSpace(void)
+{
+   if (m_evFreeMap == nullptr)
+   {
+      return EE_MAX_EVENTS;
+   }
 
-   if (i < EE_MAX_EVENTS && !confirmed)
+   // lowest set bit of the first non-empty word of the free map is the first free slot
+   for (uint16_t word = 0; word < ((EE_MAX_EVENTS + 31U) / 32U); word++)
    {
-      EVENT_INFO_t evInfo;
-      readEvent(i, evInfo);
-      if (!((evInfo.nodeNumber == nn) && (evInfo.eventNumber == en)))
+      if (m_evFreeMap[word] != 0)
       {
-         // the stored NN and EN do not match this event
-         i = EE_MAX_EVENTS;
+         return static_cast<uint16_t>((word * 32U) + __builtin_ctz(m_evFreeMap[word]));
       }
    }
 
-   return i;
+   return EE_MAX_EVENTS;
 }
 
 ///
-/// @brief Find first empty slot in the Event Table
+/// @brief Find the first stored event at or after an index in the Event Table
 ///
-/// @return uint8_t index of the event slot, or EE_MAX_EVENTS if no free slot found
+/// @param idx index of the event slot to start from
+/// @return uint16_t index of the event slot, or EE_MAX_EVENTS if no further event is stored
 ///
-uint8_t CBUSConfig::findEventSpace(void)
+uint16_t CBUSConfig::findNextEvent(uint16_t idx)
 {
-   uint8_t evidx;
+   if ((m_evFreeMap == nullptr) || (idx >= EE_MAX_EVENTS))
+   {
+      return EE_MAX_EVENTS;
+   }
 
-   for (evidx = 0; evidx < EE_MAX_EVENTS; evidx++)
+   // used slots are clear in the free map, so skip whole words of free slots
+   uint16_t word = idx / 32U;
+   uint32_t used = ~m_evFreeMap[word] & (0xFFFFFFFFUL << (idx % 32U));
+
+   while (used == 0)
    {
-      if (m_evhashtbl[evidx] == 0)
+      if (++word >= ((EE_MAX_EVENTS + 31U) / 32U))
       {
-         break;
+         return EE_MAX_EVENTS;
       }
+
+      used = ~m_evFreeMap[word];
    }
 
-   return evidx;
+   // bits beyond the last slot are also clear in the free map
+   uint16_t next = static_cast<uint16_t>((word * 32U) + __builtin_ctz(used));
+
+   return (next < EE_MAX_EVENTS) ? next : EE_MAX_EVENTS;
 }
 
 ///
@@ -418,13 +510,32 @@ uint8_t CBUSConfig::makeHash(EVENT_INFO_t& evInfo)
    return hash;
 }
 
+///
+/// @brief Read an event, served from the RAM key cache once the event index is built
+/// 
+/// @param idx Index of the event to read
+/// @param evInfo Event info of the event (node number / event number)
+///
+void CBUSConfig::readEvent(uint16_t idx, EVENT_INFO_t &evInfo)
+{
+   if (m_evKeys != nullptr && idx < EE_MAX_EVENTS)
+   {
+      evInfo.nodeNumber = static_cast<uint16_t>(m_evKeys[idx] >> 16);
+      evInfo.eventNumber = static_cast<uint16_t>(m_evKeys[idx]);
+   }
+   else
+   {
+      readEventStorage(idx, evInfo);
+   }
+}
+
 ///
 /// @brief Read an event from the EEPROM
 /// 
 /// @param idx Index of the event to read
 /// @param evInfo Event info of the event (node number / event number)
 ///
-void CBUSConfig::readEvent(uint8_t idx, EVENT_INFO_t &evInfo)
+void CBUSConfig::readEventStorage(uint16_t idx, EVENT_INFO_t &evInfo)
 {
    evInfo.nodeNumber = (readEEPROM(EE_EVENTS_START + (idx * EE_BYTES_PER_EVENT) + 0) << 8) +
                        (readEEPROM(EE_EVENTS_START + (idx * EE_BYTES_PER_EVENT) + 1));
@@ -440,8 +551,14 @@ void CBUSConfig::readEvent(uint8_t idx, EVENT_INFO_t &evInfo)
 /// @param evnum Index of the event variable to read
 /// @return uint8_t Value of the event variable
 ///
-uint8_t CBUSConfig::getEventEVval(uint8_t idx, uint8_t evnum)
+uint8_t CBUSConfig::getEventEVval(uint16_t idx, uint8_t evnum)
 {
+   // Serve from the RAM mirror when it holds this event variable
+   if (m_evMirror != nullptr && evnum >= 1 && evnum <= m_evMirrorEVs && idx < EE_MAX_EVENTS)
+   {
+      return m_evMirror[(idx * m_evMirrorEVs) + evnum - 1];
+   }
+
    return readEEPROM(EE_EVENTS_START + (idx * EE_BYTES_PER_EVENT) + 3 + evnum);
 }
 
@@ -452,9 +569,94 @@ uint8_t CBUSConfig::getEventEVval(uint8_t idx, uint8_t evnum)
 /// @param evnum Index of the event variable to write
 /// @param evval Value of the event variable to write
 ///
-void CBUSConfig::writeEventEV(uint8_t idx, uint8_t evnum, uint8_t evval)
+void CBUSConfig::writeEventEV(uint16_t idx, uint8_t evnum, uint8_t evval)
 {
    writeEEPROM(EE_EVENTS_START + (idx * EE_BYTES_PER_EVENT) + 3 + evnum, evval);
+
+   // Keep the RAM mirror coherent
+   if (m_evMirror != nullptr && evnum >= 1 && evnum <= m_evMirrorEVs && idx < EE_MAX_EVENTS)
+   {
+      m_evMirror[(idx * m_evMirrorEVs) + evnum - 1] = evval;
+   }
+}
+
+///
+/// @brief Mirror the first event variables of every event in RAM, so consuming an event
+///        doesn't read storage.  The mirror is loaded with the event table, or immediately
+///        if the event table is already loaded
+///
+/// @param numEVs Number of event variables per event to mirror, limited to EE_NUM_EVS, 0 to disable
+/// @return true The mirror is in the requested state
+/// @return false There wasn't enough memory for the mirror
+///
+bool CBUSConfig::setEVMirror(uint8_t numEVs)
+{
+   m_evMirrorReq = numEVs;
+
+   // Load now if the event table is already loaded, otherwise when it is
+   if (numEVs == 0 || m_evKeys != nullptr)
+   {
+      return loadEVMirror();
+   }
+
+   return true;
+}
+
+///
+/// @brief Get the mirrored event variables of an event
+///
+/// @param idx Index of the event
+/// @return const uint8_t* The first getEVMirror() event variables of the event, nullptr if not mirrored
+///
+const uint8_t *CBUSConfig::getEventEVs(uint16_t idx)
+{
+   if (m_evMirror == nullptr || idx >= EE_MAX_EVENTS)
+   {
+      return nullptr;
+   }
+
+   return &m_evMirror[idx * m_evMirrorEVs];
+}
+
+///
+/// @brief (Re)allocate the event variable mirror to the requested size and load it from storage
+///
+/// @return true The mirror is in the requested state
+/// @return false There wasn't enough memory for the mirror
+///
+bool CBUSConfig::loadEVMirror(void)
+{
+   if (m_evMirror != nullptr)
+   {
+      delete[] m_evMirror;
+      m_evMirror = nullptr;
+   }
+
+   m_evMirrorEVs = (m_evMirrorReq < EE_NUM_EVS) ? m_evMirrorReq : EE_NUM_EVS;
+
+   if (m_evMirrorEVs == 0 || EE_MAX_EVENTS == 0)
+   {
+      m_evMirrorEVs = 0;
+      return (m_evMirrorReq == 0);
+   }
+
+   m_evMirror = new (std::nothrow) uint8_t[EE_MAX_EVENTS * m_evMirrorEVs];
+
+   if (m_evMirror == nullptr)
+   {
+      m_evMirrorEVs = 0;
+      return false;
+   }
+
+   for (int_fast32_t idx = 0; idx < EE_MAX_EVENTS; idx++)
+   {
+      for (uint8_t ev = 1; ev <= m_evMirrorEVs; ev++)
+      {
+         m_evMirror[(idx * m_evMirrorEVs) + ev - 1] = readEEPROM(EE_EVENTS_START + (idx * EE_BYTES_PER_EVENT) + 3 + ev);
+      }
+   }
+
+   return true;
 }
 
 ///
@@ -474,7 +676,71 @@ void CBUSConfig::makeEvHashTable(void)
    // Allocate the hash table
    m_evhashtbl = new (std::nothrow) uint8_t[EE_MAX_EVENTS];
 
-   if (!m_evhashtbl)
+   // Delete any previously allocated event index
+   if (m_evIndex != nullptr)
+   {
+      delete[] m_evIndex;
+   }
+
+   // Size the event index to a power of two at least twice the number of events,
+   // keeping the load factor at or below one half so probe sequences stay short
+   m_evIndexBits = 1;
+
+   while ((1U << m_evIndexBits) < (2U * EE_MAX_EVENTS))
+   {
+      ++m_evIndexBits;
+   }
+
+   m_evIndexMask = (1U << m_evIndexBits) - 1;
+
+   // Allocate the event index
+   m_evIndex = new (std::nothrow) EVENT_INDEX_t[m_evIndexMask + 1];
+
+   // Delete any previously allocated event key cache
+   if (m_evKeys != nullptr)
+   {
+      delete[] m_evKeys;
+   }
+
+   // Allocate the event key cache, one (NN, EN) key per event slot
+   m_evKeys = new (std::nothrow) uint32_t[EE_MAX_EVENTS];
+
+   // Delete any previously allocated free slot map
+   if (m_evFreeMap != nullptr)
+   {
+      delete[] m_evFreeMap;
+   }
+
+   // Allocate the free slot map, one bit per event slot
+   m_evFreeMap = new (std::nothrow) uint32_t[(EE_MAX_EVENTS + 31U) / 32U];
+
+   // Delete any previously allocated prefilter
+   if (m_evFilter != nullptr)
+   {
+      delete[] m_evFilter;
+   }
+
+   // Size the prefilter to a power of two number of bits, at least one word
+   uint32_t filterBits = 32;
+
+   while (filterBits < (static_cast<uint32_t>(EVENT_FILTER_BITS_PER_EVENT) * EE_MAX_EVENTS))
+   {
+      filterBits <<= 1;
+   }
+
+   m_evFilterMask = filterBits - 1;
+
+   // Allocate the prefilter
+   m_evFilter = new (std::nothrow) uint32_t[filterBits / 32U];
+
+   // Resize the short event slot map to the event table, if enabled
+   if (m_shortSlots != nullptr)
+   {
+      delete[] m_shortSlots;
+      m_shortSlots = new (std::nothrow) uint16_t[EE_MAX_EVENTS];
+   }
+
+   if (!m_evhashtbl || !m_evIndex || !m_evKeys || !m_evFreeMap || !m_evFilter || (m_shortBits && !m_shortSlots))
    {
       while (1)
       {
@@ -482,88 +748,471 @@ void CBUSConfig::makeEvHashTable(void)
       };
    }
 
-   for (int_fast8_t idx = 0; idx < EE_MAX_EVENTS; idx++)
+   // start with every slot free, then add each stored event
+   clearEvHashTable();
+
+   for (int_fast32_t idx = 0; idx < EE_MAX_EVENTS; idx++)
+   {
+      readEventStorage(idx, evInfo);
+      setSlotKey(idx, makeEventKey(evInfo.nodeNumber, evInfo.eventNumber));
+   }
+
+   // Load the event variable mirror, if requested
+   if (m_evMirrorReq != 0)
    {
-      readEvent(idx, evInfo);
+      loadEVMirror();
+   }
+}
 
-      // empty slots have all four bytes set to 0xff
-      if (evInfo == evInfoUnused)
+///
+/// @brief Update an event hash table entry
+///
+/// @param idx Index of the event to update
+///
+void CBUSConfig::updateEvHashEntry(uint16_t idx)
+{
+   EVENT_INFO_t evInfo;
+
+   // read the first four bytes from EEPROM - NN + EN, in case the event
+   // was written directly to EEPROM rather than through writeEvent()
+   readEventStorage(idx, evInfo);
+
+   setSlotKey(idx, makeEventKey(evInfo.nodeNumber, evInfo.eventNumber));
+}
+
+////
+/// @brief Clear the event hash table
+///
+void CBUSConfig::clearEvHashTable(void)
+{
+   // zero in the hash table indicates that the corresponding event slot is free
+   for (int_fast32_t i = 0; i < EE_MAX_EVENTS; i++)
+   {
+      m_evhashtbl[i] = 0;
+   }
+
+   // empty the event index, key cache and hash bucket counts, and mark every slot free
+   if (m_evIndex != nullptr)
+   {
+      for (uint32_t pos = 0; pos <= m_evIndexMask; pos++)
       {
-         m_evhashtbl[idx] = 0;
+         m_evIndex[pos].key = EVENT_KEY_UNUSED;
       }
-      else
+
+      for (int_fast32_t i = 0; i < EE_MAX_EVENTS; i++)
       {
-         m_evhashtbl[idx] = makeHash(evInfo);
+         m_evKeys[i] = EVENT_KEY_UNUSED;
       }
+
+      for (uint16_t word = 0; word < ((EE_MAX_EVENTS + 31U) / 32U); word++)
+      {
+         uint16_t bits = EE_MAX_EVENTS - (word * 32U);
+         m_evFreeMap[word] = (bits >= 32U) ? 0xFFFFFFFFUL : ((1UL << bits) - 1);
+      }
+
+      memset(m_hashCounts, 0, sizeof(m_hashCounts));
+      memset(m_evFilter, 0, ((m_evFilterMask + 1U) / 32U) * sizeof(uint32_t));
+   }
+
+   if (m_shortBits != nullptr)
+   {
+      clearShortEvents();
    }
 
-   m_bHashCollisions = check_hash_collisions();
+   m_evFilterStale = 0;
+
+   m_numEvents = 0;
+   m_numHashCollisions = 0;
+   m_bHashCollisions = false;
 }
 
 ///
-/// @brief Update an event hash table entry
+/// @brief Set the event held by an event table slot, keeping the hash table,
+///        event index, key cache, free slot map and counts in step
 ///
-/// @param idx Index of the event to update
+/// @param idx Index of the event slot
+/// @param key Combined node number / event number key, EVENT_KEY_UNUSED to free the slot
 ///
-void CBUSConfig::updateEvHashEntry(uint8_t idx)
+void CBUSConfig::setSlotKey(uint16_t idx, uint32_t key)
 {
-   EVENT_INFO_t evInfo;
+   uint32_t oldKey = m_evKeys[idx];
 
-   // read the first four bytes from EEPROM - NN + EN
-   readEvent(idx, evInfo);
+   // rewriting the same event, e.g. when its EVs are updated, leaves everything unchanged
+   if (oldKey == key)
+   {
+      return;
+   }
 
-   // empty slots have all four bytes set to 0xff
-   if (evInfo == evInfoUnused)
+   // release the slot from its current event
+   if (oldKey != EVENT_KEY_UNUSED)
    {
+      indexRemove(oldKey, idx);
+
+      if (--m_hashCounts[m_evhashtbl[idx]] > 0)
+      {
+         --m_numHashCollisions;
+      }
+
       m_evhashtbl[idx] = 0;
+      m_evFreeMap[idx / 32U] |= (1UL << (idx % 32U));
+      --m_numEvents;
+      ++m_evFilterStale;
    }
-   else
+
+   m_evKeys[idx] = key;
+
+   // and claim it for the new event
+   if (key != EVENT_KEY_UNUSED)
    {
+      EVENT_INFO_t evInfo {.nodeNumber = static_cast<uint16_t>(key >> 16), .eventNumber = static_cast<uint16_t>(key)};
       m_evhashtbl[idx] = makeHash(evInfo);
+
+      if (m_hashCounts[m_evhashtbl[idx]]++ > 0)
+      {
+         ++m_numHashCollisions;
+      }
+
+      m_evFreeMap[idx / 32U] &= ~(1UL << (idx % 32U));
+      ++m_numEvents;
+
+      indexInsert(key, idx);
+      filterAdd(key);
    }
 
-   m_bHashCollisions = check_hash_collisions();
+   // short events follow whichever slot the event index holds for them
+   if (m_shortBits != nullptr)
+   {
+      if ((oldKey >> 16) == 0)
+      {
+         updateShortEvent(static_cast<uint16_t>(oldKey));
+      }
+
+      if ((key >> 16) == 0)
+      {
+         updateShortEvent(static_cast<uint16_t>(key));
+      }
+   }
+
+   // prefilter bits can't be cleared, as they may be shared with other events,
+   // so rebuild it once stale entries outnumber the stored events
+   if (m_evFilterStale > m_numEvents)
+   {
+      rebuildFilter();
+   }
+
+   m_bHashCollisions = (m_numHashCollisions != 0);
 }
 
-////
-/// @brief Clear the event hash table
 ///
-void CBUSConfig::clearEvHashTable(void)
+/// @brief Compute the home position of a key in the event index
+///
+/// @param key Combined node number / event number key
+/// @return uint32_t Position in the event index where probing starts
+///
+uint32_t CBUSConfig::indexHome(uint32_t key)
 {
-   // zero in the hash table indicates that the corresponding event slot is free
-   for (int_fast8_t i = 0; i < EE_MAX_EVENTS; i++)
+   // Fibonacci hashing, the top bits of the product are well mixed across all 32 bits of the key
+   return static_cast<uint32_t>(key * 0x9E3779B1UL) >> (32 - m_evIndexBits);
+}
+
+///
+/// @brief Lookup an event in the event index
+///
+/// @param key Combined node number / event number key
+/// @return uint16_t Index of the event, EE_MAX_EVENTS if the event is not found
+///
+uint16_t CBUSConfig::indexFind(uint32_t key)
+{
+   // Index not yet built, or the unused key which is never indexed
+   if (m_evIndex == nullptr || key == EVENT_KEY_UNUSED)
    {
-      m_evhashtbl[i] = 0;
+      return EE_MAX_EVENTS;
    }
 
-   m_bHashCollisions = false;
+   // Linear probe from the home position until the key or an empty entry is found
+   for (uint32_t pos = indexHome(key); m_evIndex[pos].key != EVENT_KEY_UNUSED; pos = (pos + 1) & m_evIndexMask)
+   {
+      if (m_evIndex[pos].key == key)
+      {
+         return m_evIndex[pos].slot;
+      }
+   }
+
+   return EE_MAX_EVENTS;
 }
 
 ///
-/// @brief Retrieve the number of currently configure / stored events
+/// @brief Add an event to the event index
+///
+/// If the key is already indexed against another slot, the lower slot is kept
+/// so lookups match the first matching event in the event table
+///
+/// @param key Combined node number / event number key
+/// @param slot Event table slot holding the event
+///
+void CBUSConfig::indexInsert(uint32_t key, uint16_t slot)
+{
+   uint32_t pos = indexHome(key);
+
+   while (m_evIndex[pos].key != EVENT_KEY_UNUSED)
+   {
+      if (m_evIndex[pos].key == key)
+      {
+         if (slot < m_evIndex[pos].slot)
+         {
+            m_evIndex[pos].slot = slot;
+         }
+
+         return;
+      }
+
+      pos = (pos + 1) & m_evIndexMask;
+   }
+
+   m_evIndex[pos].key = key;
+   m_evIndex[pos].slot = slot;
+}
+
+///
+/// @brief Remove an event from the event index
+///
+/// Uses backward shift deletion, so no tombstones are left behind
+/// and probe sequences don't degrade as events are learnt and unlearnt
+///
+/// @param key Combined node number / event number key
+/// @param slot Event table slot that held the event
+///
+void CBUSConfig::indexRemove(uint32_t key, uint16_t slot)
+{
+   uint32_t pos = indexHome(key);
+
+   while (m_evIndex[pos].key != key)
+   {
+      if (m_evIndex[pos].key == EVENT_KEY_UNUSED)
+      {
+         // not indexed
+         return;
+      }
+
+      pos = (pos + 1) & m_evIndexMask;
+   }
+
+   // the key is indexed against a different (duplicate) slot
+   if (m_evIndex[pos].slot != slot)
+   {
+      return;
+   }
+
+   // shift back any following entries that would no longer be reachable
+   for (uint32_t next = (pos + 1) & m_evIndexMask; m_evIndex[next].key != EVENT_KEY_UNUSED; next = (next + 1) & m_evIndexMask)
+   {
+      uint32_t home = indexHome(m_evIndex[next].key);
+
+      // distance from home to the hole and to the entry, wrapping around the index
+      if (((pos - home) & m_evIndexMask) < ((next - home) & m_evIndexMask))
+      {
+         m_evIndex[pos] = m_evIndex[next];
+         pos = next;
+      }
+   }
+
+   m_evIndex[pos].key = EVENT_KEY_UNUSED;
+}
+
+///
+/// @brief Mix the bits of an event key for the prefilter (MurmurHash3 finalizer),
+///        the result and its halves swapped each select one prefilter bit
+///
+/// @param key Combined node number / event number key
+/// @return uint32_t Mixed key
+///
+uint32_t CBUSConfig::filterMix(uint32_t key)
+{
+   key ^= key >> 16;
+   key *= 0x85EBCA6BUL;
+   key ^= key >> 13;
+   key *= 0xC2B2AE35UL;
+   key ^= key >> 16;
+
+   return key;
+}
+
+///
+/// @brief Add an event to the prefilter
 ///
-/// @return uint8_t Number of stored events
+/// @param key Combined node number / event number key
 ///
-uint8_t CBUSConfig::numEvents(void)
+void CBUSConfig::filterAdd(uint32_t key)
 {
-   uint8_t numevents = 0;
+   uint32_t hash = filterMix(key);
+   uint32_t bit1 = hash & m_evFilterMask;
+   uint32_t bit2 = ((hash >> 16) | (hash << 16)) & m_evFilterMask;
+
+   m_evFilter[bit1 / 32U] |= (1UL << (bit1 % 32U));
+   m_evFilter[bit2 / 32U] |= (1UL << (bit2 % 32U));
+}
 
-   for (int_fast8_t i = 0; i < EE_MAX_EVENTS; i++)
+///
+/// @brief Rebuild the prefilter from the event key cache, dropping unlearnt events
+///
+void CBUSConfig::rebuildFilter(void)
+{
+   memset(m_evFilter, 0, ((m_evFilterMask + 1U) / 32U) * sizeof(uint32_t));
+
+   for (int_fast32_t i = 0; i < EE_MAX_EVENTS; i++)
    {
-      if (m_evhashtbl[i] != 0)
+      if (m_evKeys[i] != EVENT_KEY_UNUSED)
       {
-         ++numevents;
+         filterAdd(m_evKeys[i]);
       }
    }
 
-   return numevents;
+   m_evFilterStale = 0;
+}
+
+///
+/// @brief Enable or disable the direct-mapped short event table. A presence bitmap over all
+///        65536 short event numbers, with a rank per bitmap word indexing a compact map of
+///        event slots ordered by event number, so a short event lookup is a few array accesses.
+///        Uses around 10KB of RAM
+///
+/// @param bEnable true to enable the short event table
+/// @return true The short event table is in the requested state
+/// @return false There wasn't enough memory to enable the short event table
+///
+bool CBUSConfig::setShortEventTable(bool bEnable)
+{
+   if (!bEnable)
+   {
+      delete[] m_shortBits;
+      delete[] m_shortRank;
+      delete[] m_shortSlots;
+
+      m_shortBits = nullptr;
+      m_shortRank = nullptr;
+      m_shortSlots = nullptr;
+      m_numShortEvents = 0;
+
+      return true;
+   }
+
+   if (m_shortBits != nullptr)
+   {
+      return true;
+   }
+
+   m_shortBits = new (std::nothrow) uint64_t[SHORT_EVENT_WORDS];
+   m_shortRank = new (std::nothrow) uint16_t[SHORT_EVENT_WORDS];
+   m_shortSlots = new (std::nothrow) uint16_t[EE_MAX_EVENTS];
+
+   if (!m_shortBits || !m_shortRank || !m_shortSlots)
+   {
+      setShortEventTable(false);
+      return false;
+   }
+
+   clearShortEvents();
+
+   // add any short events already stored
+   if (m_evKeys != nullptr)
+   {
+      for (int_fast32_t i = 0; i < EE_MAX_EVENTS; i++)
+      {
+         if ((m_evKeys[i] >> 16) == 0)
+         {
+            updateShortEvent(static_cast<uint16_t>(m_evKeys[i]));
+         }
+      }
+   }
+
+   return true;
+}
+
+///
+/// @brief Position of a short event in the compact slot map, the number of
+///        short events stored with a lower event number
+///
+/// @param en Event Number
+/// @return uint16_t Position in the slot map
+///
+uint16_t CBUSConfig::shortPosition(uint16_t en)
+{
+   uint64_t below = m_shortBits[en / 64U] & ((1ULL << (en % 64U)) - 1);
+
+   return m_shortRank[en / 64U] + static_cast<uint16_t>(__builtin_popcountll(below));
+}
+
+///
+/// @brief Bring a short event in the short event table in line with the event index
+///
+/// @param en Event Number
+///
+void CBUSConfig::updateShortEvent(uint16_t en)
+{
+   uint16_t slot = indexFind(makeEventKey(0, en));
+   uint16_t word = en / 64U;
+   uint64_t bit = 1ULL << (en % 64U);
+   uint16_t pos = shortPosition(en);
+
+   if (m_shortBits[word] & bit)
+   {
+      if (slot < EE_MAX_EVENTS)
+      {
+         // still stored, the slot may have changed
+         m_shortSlots[pos] = slot;
+         return;
+      }
+
+      // no longer stored, close the gap in the slot map
+      memmove(&m_shortSlots[pos], &m_shortSlots[pos + 1], (m_numShortEvents - pos - 1) * sizeof(uint16_t));
+      m_shortBits[word] &= ~bit;
+      --m_numShortEvents;
+
+      for (uint16_t w = word + 1; w < SHORT_EVENT_WORDS; w++)
+      {
+         --m_shortRank[w];
+      }
+   }
+   else if (slot < EE_MAX_EVENTS)
+   {
+      // newly stored, open a gap in the slot map
+      memmove(&m_shortSlots[pos + 1], &m_shortSlots[pos], (m_numShortEvents - pos) * sizeof(uint16_t));
+      m_shortSlots[pos] = slot;
+      m_shortBits[word] |= bit;
+      ++m_numShortEvents;
+
+      for (uint16_t w = word + 1; w < SHORT_EVENT_WORDS; w++)
+      {
+         ++m_shortRank[w];
+      }
+   }
+}
+
+///
+/// @brief Empty the short event table
+///
+void CBUSConfig::clearShortEvents(void)
+{
+   memset(m_shortBits, 0, SHORT_EVENT_WORDS * sizeof(uint64_t));
+   memset(m_shortRank, 0, SHORT_EVENT_WORDS * sizeof(uint16_t));
+   m_numShortEvents = 0;
+}
+
+///
+/// @brief Retrieve the number of currently configure / stored events
+///
+/// @return uint16_t Number of stored events
+///
+uint16_t CBUSConfig::numEvents(void)
+{
+   return m_numEvents;
 }
 
 //
 /// return a single hash table entry by index
 //
 
-uint8_t CBUSConfig::getEvTableEntry(uint8_t tindex)
+uint8_t CBUSConfig::getEvTableEntry(uint16_t tindex)
 {
    if (tindex < EE_MAX_EVENTS)
    {
@@ -697,14 +1346,15 @@ void CBUSConfig::writeEEPROM(uint32_t eeaddress, uint8_t data, bool bFlush)
 
    case EEPROM_TYPE::EEPROM_USES_FLASH:
       setChipEEPROMVal(eeaddress, data);
-      if (bFlush)
-      {
-         flushToFlash();
-      }
       break;
    }
 
    enableIRQs();
+
+   if ((m_eepromType == EEPROM_TYPE::EEPROM_USES_FLASH) && bFlush)
+   {
+      flushToFlash();
+   }
 }
 
 ///
@@ -746,13 +1396,16 @@ void CBUSConfig::writeBytesEEPROM(uint32_t eeaddress, uint8_t src[], uint8_t num
       {
          setChipEEPROMVal(eeaddress + i, src[i]);
       }
-
-      // Flush to flash
-      flushToFlash();
       break;
    }
 
    enableIRQs();
+
+   // Flush to flash
+   if (m_eepromType == EEPROM_TYPE::EEPROM_USES_FLASH)
+   {
+      flushToFlash();
+   }
 }
 
 ///
@@ -762,10 +1415,16 @@ void CBUSConfig::writeBytesEEPROM(uint32_t eeaddress, uint8_t src[], uint8_t num
 /// @param evInfo event information for the event (node number and event number)
 /// @param bFlush set to false to prevent an immediate write to flash
 ///
-void CBUSConfig::writeEvent(const uint8_t index, EVENT_INFO_t &evInfo, bool bFlush)
+void CBUSConfig::writeEvent(const uint16_t index, EVENT_INFO_t &evInfo, bool bFlush)
 {
    uint32_t eeaddress = EE_EVENTS_START + (index * EE_BYTES_PER_EVENT);
 
+   // Keep the in-memory event tables in step with the event table
+   if (m_evIndex != nullptr)
+   {
+      setSlotKey(index, makeEventKey(evInfo.nodeNumber, evInfo.eventNumber));
+   }
+
    // Write node number and event number to flash, no flush on each byte
    writeEEPROM(eeaddress + 0, highByte(evInfo.nodeNumber), false);
    writeEEPROM(eeaddress + 1, lowByte(evInfo.nodeNumber), false);
@@ -785,7 +1444,7 @@ void CBUSConfig::writeEvent(const uint8_t index, EVENT_INFO_t &evInfo, bool bFlu
 /// @param index Index of the event to clear
 /// @param bFlush true if data should be flushed to flash
 ///
-void CBUSConfig::clearEventEEPROM(uint8_t index, bool bFlush)
+void CBUSConfig::clearEventEEPROM(uint16_t index, bool bFlush)
 {
    writeEvent(index, evInfoUnused, bFlush);
 }
@@ -795,7 +1454,7 @@ void CBUSConfig::clearEventEEPROM(uint8_t index, bool bFlush)
 ///
 void CBUSConfig::clearEventsEEPROM()
 {
-   for (int_fast8_t e = 0; e < EE_MAX_EVENTS; e++)
+   for (int_fast32_t e = 0; e < EE_MAX_EVENTS; e++)
    {
       // Clear each event, not flush on each clear
       clearEventEEPROM(e, false);
@@ -828,11 +1487,7 @@ void CBUSConfig::commitChanges()
 {
    if (m_eepromType == EEPROM_TYPE::EEPROM_USES_FLASH)
    {
-      disableIRQs();
-
       flushToFlash();
-
-      enableIRQs();
    }
 }
 
@@ -919,7 +1574,9 @@ void CBUSConfig::resetModule(void)
    if (m_eepromType == EEPROM_TYPE::EEPROM_USES_FLASH)
    {
       // Erase all of Flash
-      flash_range_erase(FLASH_OFFSET, FLASH_SECTOR_SIZE);
+      beginFlashWrite();
+      flash_range_erase(FLASH_OFFSET, FLASH_STORAGE_SIZE);
+      endFlashWrite();
    }
    else
    {
@@ -984,19 +1641,8 @@ void CBUSConfig::loadNVs(void)
 ///
 bool CBUSConfig::check_hash_collisions(void)
 {
-   for (int_fast8_t i = 0; i < EE_MAX_EVENTS - 1; i++)
-   {
-      for (int_fast8_t j = i + 1; j < EE_MAX_EVENTS; j++)
-      {
-         if (m_evhashtbl[i] == m_evhashtbl[j] && m_evhashtbl[i] != 0)
-         {
-            // return when first collision detected
-            return true;
-         }
-      }
-   }
-
-   return false;
+   // bucket occupancy is counted as events are added and removed
+   return (m_numHashCollisions != 0);
 }
 
 ///
@@ -1014,16 +1660,18 @@ void CBUSConfig::setChipEEPROMVal(uint32_t eeaddress, uint8_t val)
       // Get current value from flash buffer cache
       uint8_t curVal = m_flashBuf[eeaddress];
 
+      uint32_t sectorBit = 1UL << (eeaddress / FLASH_SECTOR_SIZE);
+
       // Check if we're changing data
       if (val != curVal)
       {
-         m_bFlashModified = true;
+         m_flashModified |= sectorBit;
       }
 
       // Check if we're modifying any bits from zero to one (i.e. we need to erase flash)
       if (val & ~curVal)
       {
-         m_bFlashZeroToOne = true;
+         m_flashZeroToOne |= sectorBit;
       }
 
       // Update cache
@@ -1032,29 +1680,43 @@ void CBUSConfig::setChipEEPROMVal(uint32_t eeaddress, uint8_t val)
 }
 
 ///
-/// @brief Flush RAM cache of Flash to Flash
+/// @brief Flush RAM cache of Flash to Flash, the other core is paused and interrupts are
+/// disabled only whilst modified sectors are erased and programmed
 ///
 void CBUSConfig::flushToFlash()
 {
-   // Has flash actually been modified?
-   if (m_bFlashModified)
+   if (m_flashModified == 0)
    {
-      // Does the modification change bits from zero to one?
-      if (m_bFlashZeroToOne)
-      {
-         // Yes, so we must erase first
-         flash_range_erase(FLASH_OFFSET, FLASH_SECTOR_SIZE);
-      }
+      return;
+   }
+
+   beginFlashWrite();
+
+   // Only sectors that have actually been modified are written
+   for (uint32_t sector = 0; sector < CBUS_FLASH_SECTORS; sector++)
+   {
+      uint32_t sectorBit = 1UL << sector;
+      uint32_t offset = sector * FLASH_SECTOR_SIZE;
 
-      /// @todo Optimize to only flash required page
+      if (m_flashModified & sectorBit)
+      {
+         // Does the modification change bits from zero to one?
+         if (m_flashZeroToOne & sectorBit)
+         {
+            // Yes, so we must erase first
+            flash_range_erase(FLASH_OFFSET + offset, FLASH_SECTOR_SIZE);
+         }
 
-      // (Re)program flash
-      flash_range_program(FLASH_OFFSET, m_flashBuf, FLASH_SECTOR_SIZE);
+         // (Re)program flash
+         flash_range_program(FLASH_OFFSET + offset, &m_flashBuf[offset], FLASH_SECTOR_SIZE);
+      }
    }
 
+   endFlashWrite();
+
    // Reset flags
-   m_bFlashModified = false;
-   m_bFlashZeroToOne = false;
+   m_flashModified = 0;
+   m_flashZeroToOne = 0;
 }
 
 ///
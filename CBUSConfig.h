@@ -52,6 +52,25 @@ class CBUSSwitch;
 constexpr uint8_t EE_HASH_BYTES = 4;
 constexpr uint8_t HASH_LENGTH = 128;
 
+/// Number of prefilter bits per event, with two bits set per event around 5% of unknown events get past the filter
+constexpr uint8_t EVENT_FILTER_BITS_PER_EVENT = 8;
+
+/// Number of 64 bit words in the short event presence bitmap, one bit per 16 bit event number
+constexpr uint16_t SHORT_EVENT_WORDS = 1024;
+
+/// Key of an empty event index entry, matches the key of an unused event slot
+constexpr uint32_t EVENT_KEY_UNUSED = 0xFFFFFFFFUL;
+
+/// Number of flash sectors used as pseudo EEPROM, define larger to store more events
+#ifndef CBUS_FLASH_SECTORS
+#define CBUS_FLASH_SECTORS 1
+#endif
+
+static_assert((CBUS_FLASH_SECTORS >= 1) && (CBUS_FLASH_SECTORS <= 32), "CBUS_FLASH_SECTORS must be between 1 and 32");
+
+/// Size of the flash pseudo EEPROM
+constexpr uint32_t FLASH_STORAGE_SIZE = FLASH_SECTOR_SIZE * CBUS_FLASH_SECTORS;
+
 /// Default I2C address of the external EEPROM
 constexpr uint8_t EEPROM_I2C_ADDR = 0x50;
 
@@ -62,6 +81,13 @@ typedef struct
    uint16_t eventNumber; ///< Event number of the event
 } EVENT_INFO_t;
 
+/// Entry in the open-addressing event index
+typedef struct
+{
+   uint32_t key; ///< Combined (NN << 16) | EN key, EVENT_KEY_UNUSED if the entry is empty
+   uint16_t slot; ///< Event table slot holding the event
+} EVENT_INDEX_t;
+
 enum class EEPROM_TYPE
 {
    EEPROM_USES_FLASH,  ///< Use Pico QPSI flash as a pseudo EEPROM
@@ -84,22 +110,31 @@ public:
    // Concurrency support
    void disableIRQs(void);
    void enableIRQs(void);
+   void setMulticoreLockout(bool bLockout);
 
    // Event management
-   uint8_t findExistingEvent(uint16_t nn, uint16_t en);
-   uint8_t findEventSpace(void);
+   uint16_t findExistingEvent(uint16_t nn, uint16_t en);
+   uint16_t findEventSpace(void);
+   uint16_t findNextEvent(uint16_t idx);
+   bool mayHaveEvent(uint16_t nn, uint16_t en);
+   bool setShortEventTable(bool bEnable);
+   inline bool getShortEventTable(void) { return m_shortBits != nullptr; };
+   static inline uint32_t makeEventKey(uint16_t nn, uint16_t en) { return (static_cast<uint32_t>(nn) << 16) | en; };
 
    // Event table and hash table management
-   uint8_t getEvTableEntry(uint8_t tindex);
-   uint8_t numEvents(void);
+   uint8_t getEvTableEntry(uint16_t tindex);
+   uint16_t numEvents(void);
    uint8_t makeHash(EVENT_INFO_t& evInfo);
-   void getEvArray(uint8_t idx);
+   void getEvArray(uint16_t idx);
    void makeEvHashTable(void);
-   void updateEvHashEntry(uint8_t idx);
+   void updateEvHashEntry(uint16_t idx);
    void clearEvHashTable(void);
    bool check_hash_collisions(void);
-   uint8_t getEventEVval(uint8_t idx, uint8_t evnum);
-   void writeEventEV(uint8_t idx, uint8_t evnum, uint8_t evval);
+   uint8_t getEventEVval(uint16_t idx, uint8_t evnum);
+   void writeEventEV(uint16_t idx, uint8_t evnum, uint8_t evval);
+   bool setEVMirror(uint8_t numEVs);
+   inline uint8_t getEVMirror(void) { return m_evMirrorEVs; };
+   const uint8_t *getEventEVs(uint16_t idx);
 
    // Node Variable management
    uint8_t readNV(uint8_t idx);
@@ -107,9 +142,9 @@ public:
    void loadNVs(void);
 
    // Event management
-   void readEvent(uint8_t idx, EVENT_INFO_t& evInfo);
-   void writeEvent(const uint8_t index, EVENT_INFO_t& evInfo, bool bFlush=true);
-   void clearEventEEPROM(uint8_t index, bool bFlush=true);
+   void readEvent(uint16_t idx, EVENT_INFO_t& evInfo);
+   void writeEvent(const uint16_t index, EVENT_INFO_t& evInfo, bool bFlush=true);
+   void clearEventEEPROM(uint16_t index, bool bFlush=true);
    void clearEventsEEPROM(void);
    void resetModule(CBUSLED &green, CBUSLED &yellow, CBUSSwitch &sw);
    void resetModule(void);
@@ -147,24 +182,68 @@ public:
    void reboot(void);
 
    /// Externally accessed variables @todo should be private with accessors !
-   uint32_t EE_EVENTS_START;   ///< Offset of variables
-   uint8_t EE_MAX_EVENTS;      ///< Maximum number of events
-   uint8_t EE_NUM_EVS;         ///< Number of event variables per event
-   uint8_t EE_BYTES_PER_EVENT; ///< Number of bytes per event (includes 16bit CAN ID and Node Number)
-   uint32_t EE_NVS_START;      ///< Start offset of Node Variables
-   uint8_t EE_NUM_NVS;         ///< Number of Node Variables
+   uint32_t EE_EVENTS_START;    ///< Offset of variables
+   uint16_t EE_MAX_EVENTS;      ///< Maximum number of events
+   uint8_t EE_NUM_EVS;          ///< Number of event variables per event
+   uint16_t EE_BYTES_PER_EVENT; ///< Number of bytes per event (includes 16bit CAN ID and Node Number)
+   uint32_t EE_NVS_START;       ///< Start offset of Node Variables
+   uint8_t EE_NUM_NVS;          ///< Number of Node Variables
 
 private:
    uint32_t m_intrStatus;
+   bool m_bMulticoreLockout;
    EEPROM_TYPE m_eepromType;
    uint8_t m_externalAddress;
    i2c_inst_t *m_i2cBus;
    uint8_t *m_evhashtbl;
    bool m_bHashCollisions;
-   bool m_bFlashModified;
-   bool m_bFlashZeroToOne;
-   uint8_t m_flashBuf[FLASH_SECTOR_SIZE];
+   uint32_t m_flashModified;
+   uint32_t m_flashZeroToOne;
+   uint8_t m_flashBuf[FLASH_STORAGE_SIZE];
    uint8_t m_canId;
    bool m_bFLiM;
    uint32_t m_nodeNum;
+   EVENT_INDEX_t *m_evIndex;
+   uint32_t m_evIndexMask;
+   uint8_t m_evIndexBits;
+   uint32_t *m_evKeys;
+   uint32_t *m_evFreeMap;
+   uint16_t m_hashCounts[256];
+   uint16_t m_numEvents;
+   uint16_t m_numHashCollisions;
+   uint32_t *m_evFilter;
+   uint32_t m_evFilterMask;
+   uint16_t m_evFilterStale;
+   uint64_t *m_shortBits;
+   uint16_t *m_shortRank;
+   uint16_t *m_shortSlots;
+   uint16_t m_numShortEvents;
+   uint8_t *m_evMirror;
+   uint8_t m_evMirrorReq;
+   uint8_t m_evMirrorEVs;
+
+   // Event index maintenance
+   void setSlotKey(uint16_t idx, uint32_t key);
+   void readEventStorage(uint16_t idx, EVENT_INFO_t& evInfo);
+   uint32_t indexHome(uint32_t key);
+   uint16_t indexFind(uint32_t key);
+   void indexInsert(uint32_t key, uint16_t slot);
+   void indexRemove(uint32_t key, uint16_t slot);
+
+   // Negative lookup prefilter maintenance
+   static uint32_t filterMix(uint32_t key);
+   void filterAdd(uint32_t key);
+   void rebuildFilter(void);
+
+   // Short event table maintenance
+   uint16_t shortPosition(uint16_t en);
+   void updateShortEvent(uint16_t en);
+   void clearShortEvents(void);
+
+   // Event variable mirror maintenance
+   bool loadEVMirror(void);
+
+   // Flash erase / program bracketing
+   void beginFlashWrite(void);
+   void endFlashWrite(void);
 };
\ No newline at end of file
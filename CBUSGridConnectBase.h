@@ -52,4 +52,24 @@ public:
    virtual bool canSend()= 0;
    virtual CANFrame get(void) = 0;
    virtual void sendCANFrame(const CANFrame &msg, bool bMore) = 0;
+
+   ///
+   /// @brief Retrieve up to max frames received from GridConnect clients,
+   /// implementations with a frame queue should override this to drain it directly
+   ///
+   /// @param out Array to receive the frames, must hold at least max frames
+   /// @param max Maximum number of frames to retrieve
+   /// @return uint8_t Number of frames copied into out
+   ///
+   virtual uint8_t getMessages(CANFrame *out, uint8_t max)
+   {
+      uint8_t count = 0;
+
+      while ((count < max) && available())
+      {
+         out[count++] = get();
+      }
+
+      return count;
+   }
 };
@@ -0,0 +1,336 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#include "CBUSMulticore.h"
+#include "SystemTick.h"
+
+#include <pico/multicore.h>
+
+//
+/// construct the inter-core bridge for a CBUS object and its configuration,
+/// both must have a lifetime longer than the bridge
+//
+
+CBUSMulticore::CBUSMulticore(CBUSbase &cbus, CBUSConfig &config) : m_cbus{cbus},
+                                                                   m_config{config},
+                                                                   m_eventHandler{nullptr},
+                                                                   m_eventHandlerEx{nullptr},
+                                                                   m_frameHandler{nullptr},
+                                                                   m_numDropped{0x0UL},
+                                                                   m_bLaunched{false},
+                                                                   m_bStackReady{false},
+                                                                   m_bLockoutReady{false}
+{
+   s_instance = this;
+}
+
+//
+/// start the CBUS stack on core1, called on core0 after the configuration has been loaded
+//
+
+void CBUSMulticore::launch(void)
+{
+   // Handlers are read by core1 from now on, so may no longer be changed
+   m_bLaunched = true;
+
+   // Allow core1 to pause this core whilst it writes to flash
+   multicore_lockout_victim_init();
+
+   multicore_launch_core1(core1Entry);
+
+   // Lockout can only be used once core1 is ready to be paused
+   while (!m_bStackReady.load(std::memory_order_acquire))
+   {
+   }
+
+   // Flash writes by either core now pause the other
+   m_config.setMulticoreLockout(true);
+   m_bLockoutReady.store(true, std::memory_order_release);
+}
+
+//
+/// core1 entry point, starts the CAN transport on this core so its interrupts are handled here
+//
+
+void CBUSMulticore::core1Entry(void)
+{
+   CBUSMulticore *self = s_instance;
+
+   // Allow core0 to pause this core whilst it writes to flash
+   multicore_lockout_victim_init();
+   self->m_bStackReady.store(true, std::memory_order_release);
+
+   // The stack may write to flash, so wait until core0 has enabled lockout
+   while (!self->m_bLockoutReady.load(std::memory_order_acquire))
+   {
+   }
+
+   self->m_cbus.setEventDriven(true);
+   self->m_cbus.begin();
+
+   while (true)
+   {
+      self->runStack();
+      self->m_cbus.waitForWork();
+   }
+}
+
+//
+/// a single iteration of the core1 loop, sends the frames queued by the application,
+/// then processes received frames
+//
+
+void CBUSMulticore::runStack(void)
+{
+   CORE_MSG_t msg;
+
+   while (m_toStack.peek(msg))
+   {
+      if (!m_cbus.sendMessage(msg.frame, msg.frame.rtr, msg.frame.ext, msg.priority))
+      {
+         // Transmit queue full, retry on the next iteration
+         break;
+      }
+
+      m_toStack.pop();
+   }
+
+   m_cbus.process();
+}
+
+//
+/// queue a CBUS message for sending by the stack on core1
+/// returns false if the inter-core queue is full
+//
+
+bool CBUSMulticore::sendMessage(CANFrame &msg, bool rtr, bool ext, uint8_t priority)
+{
+   CORE_MSG_t coreMsg = {};
+
+   coreMsg.type = CORE_MSG_TYPE::CORE_MSG_SEND;
+   coreMsg.priority = priority;
+   coreMsg.frame = msg;
+   coreMsg.frame.rtr = rtr;
+   coreMsg.frame.ext = ext;
+
+   if (!m_toStack.put(coreMsg))
+   {
+      return false;
+   }
+
+   // Wake core1 if it is sleeping
+   CBUSbase::signalWakeup();
+
+   return true;
+}
+
+//
+/// register the application callback for learned events, called on core0 by process(),
+/// returns false and the callback is ignored if the stack has already been launched
+//
+
+bool CBUSMulticore::setEventHandlerCB(eventCallback_t evCallback)
+{
+   if (m_bLaunched)
+   {
+      return false;
+   }
+
+   m_eventHandler = evCallback;
+   m_cbus.setEventHandlerCB((evCallback != nullptr) ? stackEventHandler : nullptr);
+
+   return true;
+}
+
+//
+/// register the application extended callback for learned events, called on core0 by process(),
+/// returns false and the callback is ignored if the stack has already been launched
+//
+
+bool CBUSMulticore::setEventHandlerExCB(eventExCallback_t evExCallback)
+{
+   if (m_bLaunched)
+   {
+      return false;
+   }
+
+   m_eventHandlerEx = evExCallback;
+   m_cbus.setEventHandlerExCB((evExCallback != nullptr) ? stackEventHandlerEx : nullptr);
+
+   return true;
+}
+
+//
+/// register the application callback for CAN frames, called on core0 by process(),
+/// returns false and the callback is ignored if the stack has already been launched
+//
+
+bool CBUSMulticore::setFrameHandler(frameCallback_t frameCallback, const opcodeMask_t &opcodes)
+{
+   if (m_bLaunched)
+   {
+      return false;
+   }
+
+   m_cbus.removeFrameHandler(stackFrameHandler);
+   m_frameHandler = frameCallback;
+
+   if (frameCallback != nullptr)
+   {
+      m_cbus.addFrameHandler(stackFrameHandler, opcodes);
+   }
+
+   return true;
+}
+
+//
+/// deliver up to num_messages notifications from the stack to the application callbacks,
+/// called from the application loop on core0, returns the number delivered
+//
+
+uint8_t CBUSMulticore::process(uint8_t num_messages)
+{
+   uint8_t count = 0;
+   CORE_MSG_t msg;
+
+   while ((count < num_messages) && m_toApp.get(msg))
+   {
+      switch (msg.type)
+      {
+      case CORE_MSG_TYPE::CORE_MSG_FRAME:
+         if (m_frameHandler != nullptr)
+         {
+            m_frameHandler(msg.frame);
+         }
+         break;
+
+      case CORE_MSG_TYPE::CORE_MSG_EVENT:
+         if (m_eventHandler != nullptr)
+         {
+            m_eventHandler(msg.index, msg.frame);
+         }
+         break;
+
+      case CORE_MSG_TYPE::CORE_MSG_EVENT_EX:
+         if (m_eventHandlerEx != nullptr)
+         {
+            m_eventHandlerEx(msg.index, msg.frame, msg.ison, msg.evval);
+         }
+         break;
+
+      default:
+         break;
+      }
+
+      count++;
+   }
+
+   return count;
+}
+
+//
+/// determine if notifications are waiting for the application
+//
+
+bool CBUSMulticore::available(void)
+{
+   return m_toApp.available();
+}
+
+//
+/// queue a notification for the application, called on core1
+//
+
+void CBUSMulticore::postToApp(const CORE_MSG_t &msg)
+{
+   if (!m_toApp.put(msg))
+   {
+      m_numDropped++;
+      return;
+   }
+
+   // Wake core0 if it is sleeping
+   SystemTick::SignalEvent();
+}
+
+//
+/// stack event handler on core1, forwards the event to core0
+//
+
+void CBUSMulticore::stackEventHandler(uint16_t index, const CANFrame &msg)
+{
+   CORE_MSG_t coreMsg = {};
+
+   coreMsg.type = CORE_MSG_TYPE::CORE_MSG_EVENT;
+   coreMsg.index = index;
+   coreMsg.frame = msg;
+
+   s_instance->postToApp(coreMsg);
+}
+
+//
+/// stack extended event handler on core1, forwards the event to core0
+//
+
+void CBUSMulticore::stackEventHandlerEx(uint16_t index, const CANFrame &msg, bool ison, uint8_t evval)
+{
+   CORE_MSG_t coreMsg = {};
+
+   coreMsg.type = CORE_MSG_TYPE::CORE_MSG_EVENT_EX;
+   coreMsg.index = index;
+   coreMsg.ison = ison;
+   coreMsg.evval = evval;
+   coreMsg.frame = msg;
+
+   s_instance->postToApp(coreMsg);
+}
+
+//
+/// stack frame handler on core1, forwards the frame to core0
+//
+
+void CBUSMulticore::stackFrameHandler(CANFrame &msg)
+{
+   CORE_MSG_t coreMsg = {};
+
+   coreMsg.type = CORE_MSG_TYPE::CORE_MSG_FRAME;
+   coreMsg.frame = msg;
+
+   s_instance->postToApp(coreMsg);
+}
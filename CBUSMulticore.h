@@ -0,0 +1,226 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include "CBUS.h"
+#include "CBUSConfig.h"
+
+/// Number of slots in each inter-core queue, must be a power of two
+constexpr uint32_t CORE_QUEUE_SLOTS = 32;
+
+//
+/// A lock-free single-producer / single-consumer queue for passing items between the cores
+///
+/// One core only calls put(), the other only calls get(), peek() and pop().  The producer
+/// owns the head index and the consumer owns the tail index, each published with release
+/// ordering, so no locks or interrupt masking are needed across the cores.
+//
+
+template <typename T, uint32_t N>
+class CBUSCoreQueue
+{
+   static_assert((N > 1) && ((N & (N - 1)) == 0), "Queue slots must be a power of two");
+
+public:
+   ///
+   /// @brief Add an item to the queue, called by the producing core
+   ///
+   /// @param item Item to add
+   /// @return true if the item was added
+   /// @return false if the queue is full
+   ///
+   bool put(const T &item)
+   {
+      uint32_t head = m_head.load(std::memory_order_relaxed);
+
+      if ((head - m_tail.load(std::memory_order_acquire)) >= N)
+      {
+         return false;
+      }
+
+      m_items[head & (N - 1)] = item;
+      m_head.store(head + 1, std::memory_order_release);
+
+      return true;
+   }
+
+   ///
+   /// @brief Copy the oldest item without removing it, called by the consuming core
+   ///
+   /// @param item Receives the oldest item
+   /// @return true if an item was copied
+   /// @return false if the queue is empty
+   ///
+   bool peek(T &item)
+   {
+      uint32_t tail = m_tail.load(std::memory_order_relaxed);
+
+      if (tail == m_head.load(std::memory_order_acquire))
+      {
+         return false;
+      }
+
+      item = m_items[tail & (N - 1)];
+
+      return true;
+   }
+
+   ///
+   /// @brief Remove the oldest item, called by the consuming core after peek()
+   ///
+   void pop(void)
+   {
+      m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+   }
+
+   ///
+   /// @brief Remove and copy the oldest item, called by the consuming core
+   ///
+   /// @param item Receives the oldest item
+   /// @return true if an item was removed
+   /// @return false if the queue is empty
+   ///
+   bool get(T &item)
+   {
+      if (!peek(item))
+      {
+         return false;
+      }
+
+      pop();
+
+      return true;
+   }
+
+   ///
+   /// @brief Determine if the queue holds any items
+   ///
+   /// @return true if the queue is not empty
+   ///
+   bool available(void)
+   {
+      return m_tail.load(std::memory_order_acquire) != m_head.load(std::memory_order_acquire);
+   }
+
+private:
+   std::atomic<uint32_t> m_head{0}; // Written by the producer only
+   std::atomic<uint32_t> m_tail{0}; // Written by the consumer only
+   T m_items[N];
+};
+
+//
+/// Types of message passed between the cores
+//
+
+enum class CORE_MSG_TYPE : uint8_t
+{
+   CORE_MSG_SEND,     ///< Frame to be sent by the CBUS stack
+   CORE_MSG_FRAME,    ///< Frame received, for the application frame handler
+   CORE_MSG_EVENT,    ///< Learned event received, for the application event handler
+   CORE_MSG_EVENT_EX  ///< Learned event received, for the application extended event handler
+};
+
+/// Message passed between the cores
+typedef struct
+{
+   CORE_MSG_TYPE type; ///< Type of message
+   uint16_t index;     ///< Event table index of a received event
+   bool ison;          ///< On / off state of a received event
+   uint8_t evval;      ///< First event variable of a received event
+   uint8_t priority;   ///< Priority of a frame to be sent
+   CANFrame frame;     ///< The frame sent or received
+} CORE_MSG_t;
+
+//
+/// @brief Runs the CBUS stack on core1, CAN reception, message dispatch and storage all
+/// take place on core1, whilst the application on core0 sends frames and receives its
+/// callbacks through a pair of lock-free inter-core queues.  Flash writes by either core
+/// pause the other with multicore lockout.
+//
+
+class CBUSMulticore
+{
+public:
+   CBUSMulticore(CBUSbase &cbus, CBUSConfig &config);
+
+   // Called on core0, handlers must be registered before launch()
+   void launch(void);
+   bool sendMessage(CANFrame &msg, bool rtr = false, bool ext = false, uint8_t priority = DEFAULT_PRIORITY);
+   bool setEventHandlerCB(eventCallback_t evCallback);
+   bool setEventHandlerExCB(eventExCallback_t evExCallback);
+   bool setFrameHandler(frameCallback_t frameCallback, const opcodeMask_t &opcodes);
+   uint8_t process(uint8_t num_messages = CORE_QUEUE_SLOTS);
+   bool available(void);
+
+   ///
+   /// @brief Retrieve the number of notifications discarded as the application queue was full
+   ///
+   /// @return uint32_t number of discarded notifications
+   ///
+   inline uint32_t getNumDropped(void) { return m_numDropped; }
+
+   // Called on core1
+   void runStack(void);
+
+private:
+   static void core1Entry(void);
+   static void stackEventHandler(uint16_t index, const CANFrame &msg);
+   static void stackEventHandlerEx(uint16_t index, const CANFrame &msg, bool ison, uint8_t evval);
+   static void stackFrameHandler(CANFrame &msg);
+   void postToApp(const CORE_MSG_t &msg);
+
+   /// Instance running the stack, used by the static core1 entry point and handlers
+   inline static CBUSMulticore *s_instance = nullptr;
+
+   CBUSbase &m_cbus;
+   CBUSConfig &m_config;
+   eventCallback_t m_eventHandler;
+   eventExCallback_t m_eventHandlerEx;
+   frameCallback_t m_frameHandler;
+   uint32_t m_numDropped;
+   bool m_bLaunched; // handlers may not be changed once core1 is running
+   std::atomic<bool> m_bStackReady; // core1 can be paused by multicore lockout
+   std::atomic<bool> m_bLockoutReady; // core0 has enabled multicore lockout
+   CBUSCoreQueue<CORE_MSG_t, CORE_QUEUE_SLOTS> m_toStack; // core0 -> core1
+   CBUSCoreQueue<CORE_MSG_t, CORE_QUEUE_SLOTS> m_toApp;   // core1 -> core0
+};
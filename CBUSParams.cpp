@@ -55,7 +55,7 @@ CBUSParams::CBUSParams(CBUSConfig const &config)
 {
    m_params.param[PAR_NPARAMS] = NUM_PARAMS;
    m_params.param[PAR_MANU] = MANU_MERG;
-   m_params.param[PAR_EVTNUM] = config.EE_MAX_EVENTS;
+   m_params.param[PAR_EVTNUM] = (config.EE_MAX_EVENTS > UINT8_MAX) ? UINT8_MAX : config.EE_MAX_EVENTS; // single byte, saturates
    m_params.param[PAR_EVNUM] = config.EE_NUM_EVS;
    m_params.param[PAR_NVNUM] = config.EE_NUM_NVS;
    m_params.param[PAR_BUSTYPE] = PB_CAN;
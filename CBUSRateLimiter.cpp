@@ -0,0 +1,186 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#include "CBUSRateLimiter.h"
+#include "SystemTick.h"
+
+/// Tokens are held in thousandths of a frame, so slow rates accumulate between refills
+static constexpr uint32_t TOKEN_SCALE = 1000;
+
+///
+/// @brief Construct a new rate limiter, all priority classes are unlimited
+///
+CBUSRateLimiter::CBUSRateLimiter() : m_buckets{}
+{
+}
+
+///
+/// @brief Set the rate of a priority class, the bucket starts full
+///
+/// @param priority CBUS major priority, 0 is the highest
+/// @param frames_per_sec Refill rate in frames per second, 0 removes the limit
+/// @param burst Maximum number of frames that may be sent back to back
+///
+void CBUSRateLimiter::setRate(uint8_t priority, uint32_t frames_per_sec, uint32_t burst)
+{
+   if (priority >= RATE_NUM_PRIORITIES)
+   {
+      return;
+   }
+
+   TOKEN_BUCKET_t &bucket = m_buckets[priority];
+
+   bucket.rate = frames_per_sec;
+   bucket.capacity = ((burst > 0) ? burst : 1) * TOKEN_SCALE;
+   bucket.tokens = bucket.capacity;
+   bucket.lastRefill = SystemTick::GetMicros();
+   bucket.blocked = false;
+}
+
+///
+/// @brief Take a token to send a frame of the given priority.  A refused frame is expected
+/// to be retried until it is sent, so is only counted as deferred on its first refusal
+///
+/// @param priority CBUS major priority, 0 is the highest
+/// @return true if the frame may be sent
+/// @return false if the frame must be deferred
+///
+bool CBUSRateLimiter::tryConsume(uint8_t priority)
+{
+   if (priority >= RATE_NUM_PRIORITIES)
+   {
+      return true;
+   }
+
+   TOKEN_BUCKET_t &bucket = m_buckets[priority];
+
+   if (bucket.rate == 0)
+   {
+      return true;
+   }
+
+   refill(bucket);
+
+   if (bucket.tokens < TOKEN_SCALE)
+   {
+      // A deferred frame is retried until it is sent, only count its first refusal
+      if (!bucket.blocked)
+      {
+         bucket.deferred++;
+         bucket.blocked = true;
+      }
+
+      return false;
+   }
+
+   bucket.tokens -= TOKEN_SCALE;
+   bucket.blocked = false;
+
+   return true;
+}
+
+///
+/// @brief Get the time until a frame of the given priority may be sent, so a caller
+/// with deferred frames can sleep until then
+///
+/// @param priority CBUS major priority, 0 is the highest
+/// @return uint32_t microseconds until a token is available, 0 if one is available now
+///
+uint32_t CBUSRateLimiter::getTimeToToken(uint8_t priority)
+{
+   if (priority >= RATE_NUM_PRIORITIES)
+   {
+      return 0;
+   }
+
+   TOKEN_BUCKET_t &bucket = m_buckets[priority];
+
+   if (bucket.rate == 0)
+   {
+      return 0;
+   }
+
+   refill(bucket);
+
+   if (bucket.tokens >= TOKEN_SCALE)
+   {
+      return 0;
+   }
+
+   // Time from the last refill for the missing thousandths to accumulate, rounded up
+   uint64_t needed = (static_cast<uint64_t>(TOKEN_SCALE - bucket.tokens) * (1000000 / TOKEN_SCALE) + bucket.rate - 1) / bucket.rate;
+   uint32_t elapsed = SystemTick::GetMicros() - bucket.lastRefill;
+
+   return (needed > elapsed) ? static_cast<uint32_t>(needed - elapsed) : 0;
+}
+
+///
+/// @brief Add the tokens accumulated since the last refill
+///
+/// @param bucket Token bucket to refill
+///
+void CBUSRateLimiter::refill(TOKEN_BUCKET_t &bucket)
+{
+   uint32_t now = SystemTick::GetMicros();
+   uint32_t elapsed = now - bucket.lastRefill;
+
+   // thousandths of a frame per microsecond is rate / 1000
+   uint64_t added = (static_cast<uint64_t>(elapsed) * bucket.rate) / (1000000 / TOKEN_SCALE);
+
+   if (added == 0)
+   {
+      // Too soon for a whole thousandth, leave the time to accumulate
+      return;
+   }
+
+   uint64_t tokens = bucket.tokens + added;
+
+   if (tokens >= bucket.capacity)
+   {
+      // Bucket full, time beyond this point earns nothing
+      bucket.tokens = bucket.capacity;
+      bucket.lastRefill = now;
+   }
+   else
+   {
+      // Only advance by the time converted to tokens, so the remainder is not lost
+      bucket.tokens = static_cast<uint32_t>(tokens);
+      bucket.lastRefill += static_cast<uint32_t>((added * (1000000 / TOKEN_SCALE)) / bucket.rate);
+   }
+}
@@ -0,0 +1,96 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#pragma once
+
+#include <cstdint>
+
+/// Number of rate limited priority classes, one per CBUS major priority
+constexpr uint8_t RATE_NUM_PRIORITIES = 4;
+
+//
+/// A token-bucket rate limiter for outbound frames, with a bucket per CBUS major priority
+///
+/// Each bucket refills at its configured rate up to its burst size, and a frame may only be
+/// sent when a token is available.  Callers defer frames that are refused, rather than
+/// dropping them.  A rate of zero leaves the priority unlimited.
+//
+
+class CBUSRateLimiter
+{
+public:
+   CBUSRateLimiter();
+
+   void setRate(uint8_t priority, uint32_t frames_per_sec, uint32_t burst = 1);
+   bool tryConsume(uint8_t priority);
+   uint32_t getTimeToToken(uint8_t priority);
+
+   ///
+   /// @brief Get the configured rate of a priority class
+   ///
+   /// @param priority CBUS major priority, 0 is the highest
+   /// @return uint32_t frames per second, 0 if unlimited
+   ///
+   inline uint32_t getRate(uint8_t priority) { return (priority < RATE_NUM_PRIORITIES) ? m_buckets[priority].rate : 0; }
+
+   ///
+   /// @brief Retrieve the number of frames deferred for lack of a token, each frame is
+   /// counted once however many times it is retried before it is sent
+   ///
+   /// @param priority CBUS major priority, 0 is the highest
+   /// @return uint32_t number of deferred frames
+   ///
+   inline uint32_t getNumDeferred(uint8_t priority) { return (priority < RATE_NUM_PRIORITIES) ? m_buckets[priority].deferred : 0; }
+
+private:
+   /// Token bucket for a priority class, tokens are held in thousandths of a frame
+   typedef struct
+   {
+      uint32_t rate;       ///< Refill rate in frames per second, 0 if unlimited
+      uint32_t capacity;   ///< Maximum tokens, in thousandths of a frame
+      uint32_t tokens;     ///< Available tokens, in thousandths of a frame
+      uint32_t lastRefill; ///< Time of the last refill in microseconds
+      uint32_t deferred;   ///< Number of deferred frames
+      bool blocked;        ///< The frame being retried has already been counted as deferred
+   } TOKEN_BUCKET_t;
+
+   void refill(TOKEN_BUCKET_t &bucket);
+
+   TOKEN_BUCKET_t m_buckets[RATE_NUM_PRIORITIES];
+};
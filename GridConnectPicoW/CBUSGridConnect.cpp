@@ -42,18 +42,14 @@
 #include <cstdio>
 #include <cctype>
 #include <cstdlib>
-#include <new>
-
-constexpr uint8_t FIFO_SIZE = 10;
 
 ///
 /// Class to encode and decode CBUS Grid Connect messages
 ///
 CBUSGridConnect::CBUSGridConnect() : m_tcpServer{}
 {
-   // NOTE: Single CAN FIFO for all instances of this class
+   // NOTE: Single statically allocated CAN FIFO for all instances of this class
    // really we should only ever have a single instance, but avoid singleton
-   m_pCANBuffer = new (std::nothrow) CBUSCircularBuffer(FIFO_SIZE);
 }
 
 ///
@@ -61,11 +57,6 @@ CBUSGridConnect::CBUSGridConnect() : m_tcpServer{}
 ///
 CBUSGridConnect::~CBUSGridConnect()
 {
-   // Clean up CAN FIFO
-   if (m_pCANBuffer != nullptr)
-   {
-      delete m_pCANBuffer;
-   }
 }
 
 ///
@@ -76,12 +67,6 @@ CBUSGridConnect::~CBUSGridConnect()
 ///
 bool CBUSGridConnect::startServer(uint16_t nPort)
 {
-   // Check we have a FIFO before starting the server
-   if (m_pCANBuffer == nullptr)
-   {
-      return false;
-   }
-
    // Attempt to start the server
    if (!serverOpen(nPort))
    {
@@ -186,8 +171,9 @@ void CBUSGridConnect::extractAndQueueGC(TCPServer_t *state, uint16_t nStart, str
                if (decodeGC(state->bufferRecv, canMsg))
                {
                   // Parse successful, so queue for sending on CAN
-                  m_pCANBuffer->put(canMsg);
+                  m_CANBuffer.put(canMsg);
                   CBUSACAN2040::sendCANMessage(canMsg);
+                  CBUSbase::signalWakeup();
                }
             }
 
@@ -380,12 +366,7 @@ err_t CBUSGridConnect::serverSend(void *arg, struct tcp_pcb *tpcb, gcMessage_t&
 ///
 bool CBUSGridConnect::available()
 {
-   if (m_pCANBuffer != nullptr)
-   {
-      return m_pCANBuffer->available();
-   }
-
-   return false;
+   return m_CANBuffer.available();
 }
 
 ///
@@ -395,9 +376,10 @@ bool CBUSGridConnect::available()
 ///
 CANFrame CBUSGridConnect::get()
 {
-   if (m_pCANBuffer != nullptr)
+   CANFrame* msg = m_CANBuffer.get();
+
+   if (msg != nullptr)
    {
-      CANFrame* msg = m_pCANBuffer->get();
       return *msg;
    }
 
@@ -406,6 +388,18 @@ CANFrame CBUSGridConnect::get()
    return msg;
 }
 
+///
+/// @brief Retrieve a burst of CAN frames from the queue
+///
+/// @param out Array to receive the frames, must hold at least max frames
+/// @param max Maximum number of frames to retrieve
+/// @return uint8_t Number of frames retrieved
+///
+uint8_t CBUSGridConnect::getMessages(CANFrame *out, uint8_t max)
+{
+   return m_CANBuffer.getMessages(out, max);
+}
+
 ///
 /// @brief Accept a client connection
 ///
@@ -52,6 +52,9 @@
 /// Maximum possible length of a Grid Connect "string", excluding null and any EOL chars
 constexpr uint8_t GC_MAX_MSG = 28;
 
+/// Number of slots in the CAN frame FIFO, a power of two, holds GC_FIFO_SLOTS - 1 frames
+constexpr uint32_t GC_FIFO_SLOTS = 16;
+
 /// Type for holding a Grid Connect string
 typedef struct
 {
@@ -104,6 +107,7 @@ public:
    // Interface to receive CAN Frames from GridConnect clients
    bool available(void);
    CANFrame get(void);
+   uint8_t getMessages(CANFrame *out, uint8_t max) override;
    // Helper to close connection - called from LwIP callback
    static void serverCloseConn(struct tcp_pcb *pClientCB, TCPServer_t* server);
    // Helper to shutdown server - called from LwIP callback
@@ -119,7 +123,7 @@ private:
    ///
    TCPServer_t m_tcpServer;
    static inline struct tcp_pcb *m_pServerCB = nullptr;
-   static inline CBUSCircularBuffer *m_pCANBuffer = nullptr;
+   static inline CBUSCircularBufferT<GC_FIFO_SLOTS> m_CANBuffer;
    static bool encodeGC(const CANFrame &canMsg, gcMessage_t &gcMsg);
    static bool decodeGC(const gcMessage_t &gcMsg, CANFrame &canMsg);
    static void uint8ToHex(const uint8_t u8, hexByteChars_t &byteStr);
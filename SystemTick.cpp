@@ -40,6 +40,7 @@
 #include "SystemTick.h"
 
 #include <pico/time.h>
+#include <hardware/sync.h>
 
 ///
 /// Get milliseconds since boot counter value
@@ -56,3 +57,20 @@ uint32_t SystemTick::GetMicros(void)
 {
    return to_us_since_boot(get_absolute_time());
 }
+
+///
+/// Sleep the core (WFE) until an event or interrupt occurs, or the timeout expires,
+/// returns true if the timeout expired
+///
+bool SystemTick::WaitForEvent(uint32_t timeout_us)
+{
+   return best_effort_wfe_or_timeout(make_timeout_time_us(timeout_us));
+}
+
+///
+/// Signal an event (SEV) to wake any core sleeping in WaitForEvent
+///
+void SystemTick::SignalEvent(void)
+{
+   __sev();
+}
@@ -48,4 +48,6 @@ struct SystemTick
    SystemTick() = delete;
    static uint32_t GetMilli(void);
    static uint32_t GetMicros(void);
+   static bool WaitForEvent(uint32_t timeout_us);
+   static void SignalEvent(void);
 };
\ No newline at end of file
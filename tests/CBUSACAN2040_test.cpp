@@ -0,0 +1,379 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#include "CBUSACAN2040.h"
+#include "CBUSConfig.h"
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <pico/stdlib.h>
+
+#include "mocklib.h"
+
+#include <cbusdefs.h>
+
+#include <vector>
+
+using namespace std;
+
+using testing::_;
+using testing::AnyNumber;
+using testing::ReturnPointee;
+
+//-----------------------------------------------------------------------------
+// Mock CAN controller, accepts frames whilst it has transmit space
+
+static uint8_t canTxSpace {0};      // Frames the controller will accept before it is busy
+static vector<can2040_msg> canTxFrames; // Frames passed to the controller for transmission
+
+static int mockCheckTransmit(struct can2040 *)
+{
+   return canTxSpace > 0;
+}
+
+static int mockTransmit(struct can2040 *, struct can2040_msg *msg)
+{
+   if (canTxSpace == 0)
+   {
+      return -1;
+   }
+
+   --canTxSpace;
+   canTxFrames.push_back(*msg);
+
+   return 0;
+}
+
+// Build an OPC_ACON frame for an event number
+static CANFrame makeEvent(uint8_t eventNum)
+{
+   CANFrame frame {.len=5, .data{OPC_ACON, 0x01, 0x02, 0x00, eventNum}};
+   return frame;
+}
+
+// Deliver a frame from the wire through the controller callback
+static void receiveFrame(CBUSACAN2040 &cbus, uint32_t id, uint8_t eventNum)
+{
+   can2040_msg msg {.id=id, .dlc=5, .data{OPC_ACON, 0x01, 0x02, 0x00, eventNum}};
+   cbus.notify_cb(nullptr, CAN2040_NOTIFY_RX, &msg);
+}
+
+// Hook the mocked SDK time and CAN controller, and clear the controller
+static void setupMocks(MockPicoSdk &mockPicoSdk, absolute_time_t &sysTime)
+{
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(ReturnPointee(&sysTime));
+   EXPECT_CALL(mockPicoSdk, can2040_check_transmit(_)).WillRepeatedly(testing::Invoke(mockCheckTransmit));
+   EXPECT_CALL(mockPicoSdk, can2040_transmit(_,_)).WillRepeatedly(testing::Invoke(mockTransmit));
+
+   dummyFlashInit();
+
+   canTxSpace = 0;
+   canTxFrames.clear();
+}
+
+// Configure a module with a small event table
+static void setupConfig(CBUSConfig &config)
+{
+   config.EE_NVS_START = 10;
+   config.EE_NUM_NVS = 10;
+   config.EE_EVENTS_START = 20;
+   config.EE_MAX_EVENTS = 10;
+   config.EE_NUM_EVS = 1;
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+   config.begin();
+}
+
+//-----------------------------------------------------------------------------
+
+// Frames are queued by major priority and transmitted highest priority first
+TEST(CBUSACAN2040, txPriorityQueues)
+{
+   absolute_time_t sysTime {0};
+   MockPicoSdk mockPicoSdk;
+   setupMocks(mockPicoSdk, sysTime);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   CBUSACAN2040 cbus(config);
+   CANFrame frame;
+
+   // Nothing can be queued before the controller is started
+   frame = makeEvent(1);
+   ASSERT_FALSE(cbus.sendMessage(frame));
+
+   ASSERT_TRUE(cbus.begin());
+
+   // Controller busy, frames are held in the queues
+   frame = makeEvent(1);
+   ASSERT_TRUE(cbus.sendMessage(frame, false, false, 0xF));
+   frame = makeEvent(2);
+   ASSERT_TRUE(cbus.sendMessage(frame));
+   frame = makeEvent(3);
+   ASSERT_TRUE(cbus.sendMessage(frame, false, false, 0x3));
+   ASSERT_TRUE(canTxFrames.empty());
+
+   // Tx complete sends the waiting frames, highest priority first
+   canTxSpace = 3;
+   cbus.notify_cb(nullptr, CAN2040_NOTIFY_TX, nullptr);
+
+   ASSERT_EQ(canTxFrames.size(), 3);
+   ASSERT_EQ(canTxFrames[0].data[4], 3);
+   ASSERT_EQ(canTxFrames[0].id >> 7, 0x3);
+   ASSERT_EQ(canTxFrames[1].data[4], 2);
+   ASSERT_EQ(canTxFrames[1].id >> 7, DEFAULT_PRIORITY);
+   ASSERT_EQ(canTxFrames[2].data[4], 1);
+   ASSERT_EQ(canTxFrames[2].id >> 7, 0xF);
+   ASSERT_EQ(canTxFrames[2].dlc, 5);
+
+   // Controller free, a frame is sent as it is queued
+   canTxSpace = 1;
+   frame = makeEvent(4);
+   ASSERT_TRUE(cbus.sendMessage(frame, true, false));
+   ASSERT_EQ(canTxFrames.size(), 4);
+   ASSERT_TRUE(canTxFrames[3].id & CAN2040_ID_RTR);
+   ASSERT_FALSE(canTxFrames[3].id & CAN2040_ID_EFF);
+}
+
+// Frames are refused once the queue for their priority is full
+TEST(CBUSACAN2040, txQueueFull)
+{
+   absolute_time_t sysTime {0};
+   MockPicoSdk mockPicoSdk;
+   setupMocks(mockPicoSdk, sysTime);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   CBUSACAN2040 cbus(config);
+   CANFrame frame;
+
+   ASSERT_TRUE(cbus.begin());
+
+   for (auto i = 0; i < tx_qsize - 1; i++)
+   {
+      frame = makeEvent(i);
+      ASSERT_TRUE(cbus.sendMessage(frame));
+   }
+
+   frame = makeEvent(tx_qsize);
+   ASSERT_FALSE(cbus.sendMessage(frame));
+
+   // Other priorities have their own queue
+   frame = makeEvent(tx_qsize);
+   ASSERT_TRUE(cbus.sendMessage(frame, false, false, 0x3));
+
+   // Frames passed to sendCANMessage carry their own header
+   frame = makeEvent(tx_qsize);
+   frame.id = (DEFAULT_PRIORITY << 7) | 0x05;
+   ASSERT_FALSE(CBUSACAN2040::sendCANMessage(frame));
+
+   // Reset discards the queued frames
+   cbus.reset();
+   canTxSpace = tx_qsize;
+   cbus.serviceTransmit();
+   ASSERT_TRUE(canTxFrames.empty());
+}
+
+// Frames over the rate limit are deferred until a token is due, and reported as pending
+TEST(CBUSACAN2040, txRateLimit)
+{
+   absolute_time_t sysTime {0};
+   MockPicoSdk mockPicoSdk;
+   setupMocks(mockPicoSdk, sysTime);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   CBUSACAN2040 cbus(config);
+   CANFrame frame;
+   uint32_t wait_us;
+
+   ASSERT_TRUE(cbus.begin());
+
+   // 10 frames per second for the default priority
+   cbus.setTxRateLimit(DEFAULT_PRIORITY >> 2, 10);
+
+   canTxSpace = 10;
+
+   for (auto i = 0; i < 3; i++)
+   {
+      frame = makeEvent(i);
+      ASSERT_TRUE(cbus.sendMessage(frame));
+   }
+
+   // Only the first frame has a token, other priorities are not limited
+   ASSERT_EQ(canTxFrames.size(), 1);
+
+   frame = makeEvent(10);
+   ASSERT_TRUE(cbus.sendMessage(frame, false, false, 0x3));
+   ASSERT_EQ(canTxFrames.size(), 2);
+   ASSERT_EQ(canTxFrames[1].data[4], 10);
+
+   // The deferred frames are pending until the next token, 100ms away
+   ASSERT_TRUE(cbus.txPending(wait_us));
+   ASSERT_EQ(wait_us, 100000);
+
+   sysTime += 50000;
+   cbus.serviceTransmit();
+   ASSERT_EQ(canTxFrames.size(), 2);
+   ASSERT_TRUE(cbus.txPending(wait_us));
+   ASSERT_EQ(wait_us, 50000);
+
+   // Each token releases one deferred frame
+   sysTime += 50000;
+   cbus.serviceTransmit();
+   ASSERT_EQ(canTxFrames.size(), 3);
+   ASSERT_EQ(canTxFrames[2].data[4], 1);
+
+   sysTime += 100000;
+   cbus.serviceTransmit();
+   ASSERT_EQ(canTxFrames.size(), 4);
+   ASSERT_EQ(canTxFrames[3].data[4], 2);
+
+   ASSERT_FALSE(cbus.txPending(wait_us));
+   ASSERT_EQ(cbus.getNumTxDeferred(DEFAULT_PRIORITY >> 2), 2);
+   ASSERT_EQ(cbus.getNumTxDeferred(0), 0);
+}
+
+// Frames waiting only for the controller are sent by the tx complete callback, not reported as pending
+TEST(CBUSACAN2040, txPendingControllerBusy)
+{
+   absolute_time_t sysTime {0};
+   MockPicoSdk mockPicoSdk;
+   setupMocks(mockPicoSdk, sysTime);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   CBUSACAN2040 cbus(config);
+   CANFrame frame;
+   uint32_t wait_us;
+
+   ASSERT_TRUE(cbus.begin());
+   ASSERT_FALSE(cbus.txPending(wait_us));
+
+   frame = makeEvent(1);
+   ASSERT_TRUE(cbus.sendMessage(frame));
+   ASSERT_FALSE(cbus.txPending(wait_us));
+
+   // Controller has space again, the frame is due now
+   canTxSpace = 1;
+   ASSERT_TRUE(cbus.txPending(wait_us));
+   ASSERT_EQ(wait_us, 0);
+
+   cbus.serviceTransmit();
+   ASSERT_EQ(canTxFrames.size(), 1);
+   ASSERT_FALSE(cbus.txPending(wait_us));
+}
+
+// Received frames are queued, the oldest frame is overwritten when the queue is full
+TEST(CBUSACAN2040, rxOverwriteOldest)
+{
+   absolute_time_t sysTime {0};
+   MockPicoSdk mockPicoSdk;
+   setupMocks(mockPicoSdk, sysTime);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   CBUSACAN2040 cbus(config);
+   CANFrame frames[rx_qsize];
+
+   // Frames are discarded until the controller is started
+   receiveFrame(cbus, (DEFAULT_PRIORITY << 7) | 0x05, 0);
+   ASSERT_FALSE(cbus.available());
+
+   ASSERT_TRUE(cbus.begin());
+   ASSERT_EQ(cbus.getRxQueue()->getOverflowPolicy(), OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST);
+
+   for (auto i = 0; i < rx_qsize; i++)
+   {
+      receiveFrame(cbus, (((i == 0) ? 0x3 : DEFAULT_PRIORITY) << 7) | 0x05, i);
+   }
+
+   ASSERT_TRUE(cbus.available());
+   ASSERT_EQ(cbus.getNextMessage().data[4], 1);
+   ASSERT_EQ(cbus.getMessages(frames, rx_qsize), rx_qsize - 2);
+   ASSERT_EQ(frames[rx_qsize - 3].data[4], rx_qsize - 1);
+   ASSERT_FALSE(cbus.available());
+}
+
+// Eviction of the lowest priority frames is an opt-in receive overflow policy
+TEST(CBUSACAN2040, rxEvictLowestPriority)
+{
+   absolute_time_t sysTime {0};
+   MockPicoSdk mockPicoSdk;
+   setupMocks(mockPicoSdk, sysTime);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   CBUSACAN2040 cbus(config);
+
+   ASSERT_TRUE(cbus.begin());
+
+   cbus.setRxOverflowPolicy(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY);
+
+   for (auto i = 0; i < rx_qsize; i++)
+   {
+      receiveFrame(cbus, (((i == 0) ? 0x3 : DEFAULT_PRIORITY) << 7) | 0x05, i);
+   }
+
+   // The high priority frame is kept, the oldest low priority frame is evicted
+   CANFrame frame = cbus.getNextMessage();
+   ASSERT_EQ(frame.data[4], 0);
+   ASSERT_EQ(frame.id >> 7, 0x3);
+   ASSERT_EQ(cbus.getNextMessage().data[4], 2);
+   ASSERT_EQ(cbus.getRxQueue()->getNumDrops(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY), 1);
+}
+
+int main(int argc, char **argv)
+{
+   // The following line must be executed to initialize Google Mock
+   // (and Google Test) before running the tests.
+   ::testing::InitGoogleMock(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -46,7 +46,28 @@
 
 #include "mocklib.h"
 
+#include <cbusdefs.h>
+
 using testing::Return;
+using testing::ReturnPointee;
+
+// Frame put by a simulated interrupt whilst the consumer is removing items.  The consumer
+// reads the time after copying items out and before releasing their slots, so putting the
+// frame from the time source interrupts it whilst the items are still claimed
+static CBUSCircularBuffer *isrBuffer = nullptr;
+static CANFrame isrFrame;
+
+static absolute_time_t isrPut(void)
+{
+   if (isrBuffer != nullptr)
+   {
+      CBUSCircularBuffer *buffer = isrBuffer;
+      isrBuffer = nullptr;
+      buffer->put(isrFrame);
+   }
+
+   return 0;
+}
 
 // Uninitialized usage test
 TEST(CBUSCircularBuffer, noInit)
@@ -234,6 +255,657 @@ TEST(CBUSCircularBuffer, overflow)
    ASSERT_EQ(buffer.getNumPuts(), 3);
    ASSERT_EQ(buffer.getNumGets(), 2);
    ASSERT_EQ(buffer.getNumOverflows(), 1);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), 1);
+}
+
+// Drop newest overflow policy test
+TEST(CBUSCircularBuffer, overflowDropNewest)
+{
+   static constexpr const auto numItems {3};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+
+   buffer.setOverflowPolicy(OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST);
+   ASSERT_EQ(buffer.getOverflowPolicy(), OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST);
+
+   for (auto i=0; i < numItems + 2; i++)
+   {
+      frame.id = i;
+      buffer.put(frame);
+   }
+
+   // Oldest frames are retained
+   ASSERT_EQ(buffer.size(), numItems);
+   ASSERT_EQ(buffer.getNumOverflows(), 2);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST), 2);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), 0);
+
+   for (auto i=0; i < numItems; i++)
+   {
+      ASSERT_EQ(buffer.get()->id, i);
+   }
+
+   ASSERT_TRUE(buffer.empty());
+}
+
+// Evict lowest priority overflow policy test
+TEST(CBUSCircularBuffer, overflowEvictLowestPriority)
+{
+   static constexpr const auto numItems {3};
+   static constexpr const uint32_t highPriority {0x0B0};   // Priority 1, CAN ID 0x30
+   static constexpr const uint32_t lowPriority {0x5B0};    // Priority 11, CAN ID 0x30
+   static constexpr const uint32_t lowPriorityExt {0x16000000};  // Priority 11, extended frame
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+   CANFrame frames[numItems];
+
+   buffer.setOverflowPolicy(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY);
+
+   // Queued low priority frame is evicted in favour of a new high priority frame
+   frame.data[0] = 1;
+   frame.id = highPriority;
+   buffer.put(frame);
+
+   frame.data[0] = 2;
+   frame.id = lowPriority;
+   buffer.put(frame);
+
+   frame.data[0] = 3;
+   frame.id = highPriority;
+   buffer.put(frame);
+
+   frame.data[0] = 4;
+   buffer.put(frame);
+
+   ASSERT_EQ(buffer.size(), numItems);
+   ASSERT_EQ(buffer.getNumOverflows(), 1);
+
+   ASSERT_EQ(buffer.getMessages(frames, numItems), numItems);
+   ASSERT_EQ(frames[0].data[0], 1);
+   ASSERT_EQ(frames[1].data[0], 3);
+   ASSERT_EQ(frames[2].data[0], 4);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY), 1);
+
+   // New low priority frame is evicted when all queued frames have a higher priority
+   for (auto i=1; i <= numItems; i++)
+   {
+      frame.data[0] = i;
+      frame.id = highPriority;
+      buffer.put(frame);
+   }
+
+   frame.data[0] = 4;
+   frame.id = lowPriorityExt;
+   frame.ext = true;
+   buffer.put(frame);
+
+   ASSERT_EQ(buffer.getMessages(frames, numItems), numItems);
+   ASSERT_EQ(frames[0].data[0], 1);
+   ASSERT_EQ(frames[1].data[0], 2);
+   ASSERT_EQ(frames[2].data[0], 3);
+   ASSERT_TRUE(buffer.empty());
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY), 2);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST), 0);
+}
+
+// Evict lowest priority when the producer fills the buffer between consumer passes
+TEST(CBUSCircularBuffer, evictWithoutConsumer)
+{
+   static constexpr const auto numSlots {32U};
+   static constexpr const auto numHigh {5U};
+   static constexpr const uint32_t highPriority {0x030};   // Priority 0, CAN ID 0x30
+   static constexpr const uint32_t lowPriority {0x5B0};    // Priority 11, CAN ID 0x30
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBufferT<numSlots> buffer;
+   CANFrame frame;
+   CANFrame frames[numSlots];
+
+   buffer.setOverflowPolicy(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY);
+
+   // Fill the buffer with low priority frames, then add high priority frames
+   frame.id = lowPriority;
+
+   for (auto i=0U; i < numSlots - 1; i++)
+   {
+      frame.data[0] = i;
+      buffer.put(frame);
+   }
+
+   frame.id = highPriority;
+
+   for (auto i=0U; i < numHigh; i++)
+   {
+      frame.data[0] = 100 + i;
+      buffer.put(frame);
+   }
+
+   ASSERT_TRUE(buffer.full());
+   ASSERT_EQ(buffer.getNumOverflows(), numHigh);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY), numHigh);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST), 0);
+
+   // Oldest low priority frames are evicted, every high priority frame is kept
+   ASSERT_EQ(buffer.getMessages(frames, numSlots), numSlots - 1);
+
+   for (auto i=0U; i < numSlots - 1 - numHigh; i++)
+   {
+      ASSERT_EQ(frames[i].id, lowPriority);
+      ASSERT_EQ(frames[i].data[0], numHigh + i);
+   }
+
+   for (auto i=0U; i < numHigh; i++)
+   {
+      ASSERT_EQ(frames[numSlots - 1 - numHigh + i].id, highPriority);
+      ASSERT_EQ(frames[numSlots - 1 - numHigh + i].data[0], 100 + i);
+   }
+
+   // A new frame of the lowest priority is discarded once only high priority frames are queued
+   for (auto i=0U; i < numSlots - 1; i++)
+   {
+      buffer.put(frame);
+   }
+
+   frame.id = lowPriority;
+   buffer.put(frame);
+
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_EVICT_LOWEST_PRIORITY), numHigh + 1);
+   ASSERT_EQ(buffer.getMessages(frames, numSlots), numSlots - 1);
+
+   for (auto i=0U; i < numSlots - 1; i++)
+   {
+      ASSERT_EQ(frames[i].id, highPriority);
+   }
+}
+
+// Index wrap-around test, capacity is not a power of two
+TEST(CBUSCircularBuffer, wrapAround)
+{
+   static constexpr const auto numItems {3};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+
+   // Repeatedly part fill and drain the buffer, so the indexes wrap many times
+   uint32_t nextPut = 0;
+   uint32_t nextGet = 0;
+
+   for (auto loop=0; loop < 100; loop++)
+   {
+      for (auto i=0; i < 2; i++)
+      {
+         frame.id = nextPut++;
+         buffer.put(frame);
+      }
+
+      ASSERT_EQ(buffer.size(), 2);
+      ASSERT_EQ(buffer.getNumFreeSlots(), numItems - 2);
+
+      while (buffer.available())
+      {
+         CANFrame* gotFrame = buffer.get();
+         ASSERT_EQ(gotFrame->id, nextGet++);
+      }
+   }
+
+   ASSERT_TRUE(buffer.empty());
+   ASSERT_EQ(buffer.getNumPuts(), 200);
+   ASSERT_EQ(buffer.getNumGets(), 200);
+   ASSERT_EQ(buffer.getNumOverflows(), 0);
+   ASSERT_EQ(buffer.getHighWaterMark(), 2);
+}
+
+// Producer runs ahead of a stalled consumer
+TEST(CBUSCircularBuffer, stalledConsumer)
+{
+   static constexpr const auto numItems {3};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+
+   // Fill the buffer, then overflow once, oldest item is overwritten
+   for (auto i=0; i < numItems + 1; i++)
+   {
+      frame.id = i;
+      buffer.put(frame);
+   }
+
+   ASSERT_TRUE(buffer.full());
+   ASSERT_EQ(buffer.size(), numItems);
+   ASSERT_EQ(buffer.getNumOverflows(), 1);
+
+   // Consumer has not caught up, the oldest items continue to be overwritten
+   frame.id = 100;
+   buffer.put(frame);
+   frame.id = 101;
+   buffer.put(frame);
+
+   ASSERT_EQ(buffer.getNumOverflows(), 3);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), 3);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_DROP_NEWEST), 0);
+   ASSERT_EQ(buffer.size(), numItems);
+
+   // The most recent items are held
+   ASSERT_EQ(buffer.get()->id, numItems);
+   ASSERT_EQ(buffer.get()->id, 100);
+   ASSERT_EQ(buffer.get()->id, 101);
+
+   ASSERT_TRUE(buffer.empty());
+   ASSERT_EQ(buffer.getNumPuts(), numItems + 3);
+   ASSERT_EQ(buffer.getNumGets(), numItems);
+}
+
+// Overwrite oldest retains the most recent items
+TEST(CBUSCircularBuffer, overwriteRetainsNewest)
+{
+   static constexpr const auto numSlots {32U};
+   static constexpr const auto numItems {20U};
+   static constexpr const auto numPuts {40U};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(testing::Invoke(isrPut));
+
+   CBUSCircularBufferT<numSlots> staticBuffer;
+   CBUSCircularBuffer heapBuffer(numItems);
+   CANFrame frame;
+   CANFrame frames[numSlots];
+
+   for (auto i=0U; i < numPuts; i++)
+   {
+      frame.id = i;
+      staticBuffer.put(frame);
+      heapBuffer.put(frame);
+   }
+
+   // Static buffer holds the last 31 items, the heap buffer the last 20
+   ASSERT_EQ(staticBuffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), numPuts - (numSlots - 1));
+   ASSERT_EQ(staticBuffer.getMessages(frames, numSlots), numSlots - 1);
+
+   for (auto i=0U; i < numSlots - 1; i++)
+   {
+      ASSERT_EQ(frames[i].id, numPuts - (numSlots - 1) + i);
+   }
+
+   ASSERT_EQ(heapBuffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), numPuts - numItems);
+   ASSERT_EQ(heapBuffer.getMessages(frames, numSlots), numItems);
+
+   for (auto i=0U; i < numItems; i++)
+   {
+      ASSERT_EQ(frames[i].id, numPuts - numItems + i);
+   }
+
+   // Items claimed by the consumer are kept, the oldest unclaimed item is overwritten
+   for (auto i=0U; i < numItems; i++)
+   {
+      frame.id = i;
+      heapBuffer.put(frame);
+   }
+
+   isrFrame.id = numItems;
+   isrBuffer = &heapBuffer;
+
+   ASSERT_EQ(heapBuffer.getMessages(frames, 2), 2);
+   ASSERT_EQ(frames[0].id, 0);
+   ASSERT_EQ(frames[1].id, 1);
+
+   ASSERT_EQ(heapBuffer.getMessages(frames, numSlots), numItems - 2);
+
+   for (auto i=0U; i < numItems - 2; i++)
+   {
+      ASSERT_EQ(frames[i].id, i + 3);
+   }
+
+   ASSERT_EQ(heapBuffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), numPuts - numItems + 1);
+   ASSERT_TRUE(heapBuffer.empty());
+}
+
+TEST(CBUSCircularBuffer, batchGet)
+{
+   static constexpr const auto numItems {5};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+   CANFrame frames[numItems];
+
+   // Nothing to retrieve
+   ASSERT_EQ(buffer.getMessages(frames, numItems), 0);
+
+   for (auto i=0; i < numItems; i++)
+   {
+      frame.id = i;
+      buffer.put(frame);
+   }
+
+   // Retrieve a partial burst
+   ASSERT_EQ(buffer.getMessages(frames, 3), 3);
+   ASSERT_EQ(frames[0].id, 0);
+   ASSERT_EQ(frames[1].id, 1);
+   ASSERT_EQ(frames[2].id, 2);
+   ASSERT_EQ(buffer.size(), 2);
+
+   // Retrieve the remainder, asking for more than is available
+   ASSERT_EQ(buffer.getMessages(frames, numItems), 2);
+   ASSERT_EQ(frames[0].id, 3);
+   ASSERT_EQ(frames[1].id, 4);
+
+   ASSERT_TRUE(buffer.empty());
+   ASSERT_EQ(buffer.getNumGets(), numItems);
+}
+
+// Put whilst the consumer is removing items from a full buffer
+TEST(CBUSCircularBuffer, putDuringGet)
+{
+   static constexpr const auto numItems {3};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(testing::Invoke(isrPut));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+   CANFrame frames[numItems + 1];
+
+   for (auto i=1; i <= numItems; i++)
+   {
+      frame.id = i;
+      buffer.put(frame);
+   }
+
+   // A peeked frame is not claimed, so it is overwritten
+   ASSERT_EQ(buffer.peek()->id, 1);
+
+   frame.id = 4;
+   buffer.put(frame);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), 1);
+   ASSERT_EQ(buffer.getNumGets(), 0);
+
+   ASSERT_EQ(buffer.getMessages(frames, numItems + 1), numItems);
+   ASSERT_EQ(frames[0].id, 2);
+   ASSERT_EQ(frames[1].id, 3);
+   ASSERT_EQ(frames[2].id, 4);
+
+   // A frame being removed stays claimed, the oldest unclaimed frame is overwritten
+   for (auto i=1; i <= numItems; i++)
+   {
+      frame.id = i;
+      buffer.put(frame);
+   }
+
+   isrFrame.id = 4;
+   isrBuffer = &buffer;
+
+   ASSERT_EQ(buffer.getMessages(frames, 1), 1);
+   ASSERT_EQ(frames[0].id, 1);
+   ASSERT_EQ(buffer.getNumDrops(OVERFLOW_POLICY::OVERFLOW_OVERWRITE_OLDEST), 2);
+   ASSERT_EQ(buffer.size(), 2);
+
+   ASSERT_EQ(buffer.getMessages(frames, numItems + 1), 2);
+   ASSERT_EQ(frames[0].id, 3);
+   ASSERT_EQ(frames[1].id, 4);
+   ASSERT_TRUE(buffer.empty());
+}
+
+// Packed storage test
+TEST(CBUSCircularBuffer, packedFrames)
+{
+   static constexpr const auto sysTime {0x12345678};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(sysTime));
+
+   CBUSCircularBuffer buffer(2);
+   CANFrame frame;
+
+   // Extended RTR frame with a full length payload
+   frame.id = 0x1FFFFFFF;
+   frame.ext = true;
+   frame.rtr = true;
+   frame.len = 8;
+
+   for (auto i=0; i < 8; i++)
+   {
+      frame.data[i] = 0xF0 + i;
+   }
+
+   buffer.put(frame);
+
+   // Standard frame without payload
+   CANFrame frame2;
+   frame2.id = 0x7FF;
+   buffer.put(frame2);
+
+   // Insert time is held to the resolution of the packed slot
+   ASSERT_EQ(buffer.getInsertTime(), sysTime & CBUS_BUFFER_TIME_MASK);
+
+   CANFrame* gotFrame = buffer.get();
+   ASSERT_EQ(gotFrame->id, 0x1FFFFFFF);
+   ASSERT_TRUE(gotFrame->ext);
+   ASSERT_TRUE(gotFrame->rtr);
+   ASSERT_EQ(gotFrame->len, 8);
+
+   for (auto i=0; i < 8; i++)
+   {
+      ASSERT_EQ(gotFrame->data[i], 0xF0 + i);
+   }
+
+   gotFrame = buffer.get();
+   ASSERT_EQ(gotFrame->id, 0x7FF);
+   ASSERT_FALSE(gotFrame->ext);
+   ASSERT_FALSE(gotFrame->rtr);
+   ASSERT_EQ(gotFrame->len, 0);
+}
+
+// Dwell time histogram test
+TEST(CBUSCircularBuffer, dwellHistogram)
+{
+   static constexpr const auto numItems {4};
+   absolute_time_t sysTime = 1000;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(ReturnPointee(&sysTime));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frame;
+   CANFrame frames[numItems];
+
+   for (auto i=0; i < CBUS_DWELL_BUCKETS; i++)
+   {
+      ASSERT_EQ(buffer.getDwellCount(i), 0);
+   }
+
+   // Retrieved immediately, bucket 0
+   buffer.put(frame);
+   buffer.get();
+   ASSERT_EQ(buffer.getDwellCount(0), 1);
+
+   // 100us dwell via get, bucket 7 (64-127us)
+   buffer.put(frame);
+   sysTime += 100;
+   buffer.get();
+   ASSERT_EQ(buffer.getDwellCount(7), 1);
+
+   // Batch retrieval, 5us and 3us dwell, bucket 3 (4-7us) and bucket 2 (2-3us)
+   buffer.put(frame);
+   sysTime += 2;
+   buffer.put(frame);
+   sysTime += 3;
+   ASSERT_EQ(buffer.getMessages(frames, numItems), 2);
+   ASSERT_EQ(buffer.getDwellCount(3), 1);
+   ASSERT_EQ(buffer.getDwellCount(2), 1);
+
+   // Dwell is recorded when items are removed, not when they are peeked
+   buffer.put(frame);
+   buffer.peek();
+   sysTime += 1;
+   buffer.get();
+   ASSERT_EQ(buffer.getDwellCount(1), 1);
+
+   // Very long dwell times are counted in the last bucket
+   buffer.put(frame);
+   sysTime += 10000000;
+   buffer.get();
+   ASSERT_EQ(buffer.getDwellCount(CBUS_DWELL_BUCKETS - 1), 1);
+   ASSERT_EQ(buffer.getDwellCount(CBUS_DWELL_BUCKETS), 0);
+
+   buffer.resetDwellHistogram();
+
+   for (auto i=0; i < CBUS_DWELL_BUCKETS; i++)
+   {
+      ASSERT_EQ(buffer.getDwellCount(i), 0);
+   }
+}
+
+// Event coalescing test
+TEST(CBUSCircularBuffer, coalesceEvents)
+{
+   static constexpr const auto numItems {4};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(testing::Invoke(isrPut));
+
+   CBUSCircularBuffer buffer(numItems);
+   CANFrame frames[numItems];
+   CANFrame event;
+   CANFrame other;
+
+   event.len = 5;
+   event.data[0] = OPC_ACON;
+   event.data[1] = 0x01;
+   event.data[2] = 0x02;
+   event.data[3] = 0x03;
+   event.data[4] = 0x04;
+
+   other = event;
+   other.data[4] = 0x05;
+
+   // Repeated events are queued when coalescing is off
+   buffer.put(event);
+   buffer.put(event);
+   ASSERT_EQ(buffer.size(), 2);
+   buffer.clear();
+
+   buffer.setCoalesceEvents(true);
+
+   // Chattering event takes a single slot, and its latest state is delivered
+   buffer.put(event);
+   buffer.put(other);
+   event.data[0] = OPC_ACOF;
+   buffer.put(event);
+   event.data[0] = OPC_ACON;
+   buffer.put(event);
+   event.data[0] = OPC_ACOF;
+   buffer.put(event);
+
+   ASSERT_EQ(buffer.size(), 2);
+   ASSERT_EQ(buffer.getNumCoalesced(), 3);
+
+   ASSERT_EQ(buffer.getMessages(frames, numItems), 2);
+   ASSERT_EQ(frames[0].data[0], OPC_ACOF);
+   ASSERT_EQ(frames[0].data[4], 0x04);
+   ASSERT_EQ(frames[1].data[4], 0x05);
+
+   // Frames held by the consumer are not replaced
+   buffer.put(event);
+   isrFrame = event;
+   isrFrame.data[0] = OPC_ACON;
+   isrBuffer = &buffer;
+   ASSERT_EQ(buffer.getMessages(frames, 1), 1);
+   ASSERT_EQ(frames[0].data[0], OPC_ACOF);
+   ASSERT_EQ(buffer.size(), 1);
+   ASSERT_EQ(buffer.get()->data[0], OPC_ACON);
+
+   // Other opcodes are not coalesced
+   event.data[0] = OPC_ACON1;
+   event.len = 6;
+   buffer.put(event);
+   event.len = 5;
+   buffer.put(event);
+   event.data[0] = OPC_NVSET;
+   buffer.put(event);
+   buffer.put(event);
+   ASSERT_EQ(buffer.size(), 4);
+   ASSERT_EQ(buffer.getNumCoalesced(), 3);
+}
+
+// Statically allocated storage test
+TEST(CBUSCircularBuffer, staticStorage)
+{
+   static constexpr const auto numSlots {8U};
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(Return(0));
+
+   CBUSCircularBufferT<numSlots> buffer;
+   CANFrame frame;
+
+   // Statically allocated buffer holds one less than its number of slots
+   ASSERT_TRUE(buffer.empty());
+   ASSERT_EQ(buffer.getNumFreeSlots(), numSlots - 1);
+
+   for (auto i=0U; i < numSlots - 1; i++)
+   {
+      frame.id = i;
+      buffer.put(frame);
+   }
+
+   ASSERT_TRUE(buffer.full());
+   ASSERT_EQ(buffer.getNumOverflows(), 0);
+
+   // One more overwrites the oldest item
+   frame.id = numSlots - 1;
+   buffer.put(frame);
+   ASSERT_EQ(buffer.getNumOverflows(), 1);
+
+   for (auto i=1U; i < numSlots; i++)
+   {
+      CANFrame* gotFrame = buffer.get();
+      ASSERT_NE(gotFrame, nullptr);
+      ASSERT_EQ(gotFrame->id, i);
+   }
+
+   ASSERT_TRUE(buffer.empty());
 }
 
 int main(int argc, char **argv)
@@ -242,4 +914,4 @@ int main(int argc, char **argv)
     // (and Google Test) before running the tests.
     ::testing::InitGoogleMock(&argc, argv);
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
@@ -0,0 +1,253 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+// Flash storage spread over more than one sector, built with CBUS_FLASH_SECTORS=2
+
+#include "CBUSConfig.h"
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <pico/stdlib.h>
+
+#include "mocklib.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+using testing::_;
+using testing::Invoke;
+using testing::AnyNumber;
+
+static_assert(CBUS_FLASH_SECTORS == 2, "Build with CBUS_FLASH_SECTORS=2");
+
+// Sectors erased and programmed since the last check
+static vector<uint32_t> erasedSectors;
+static vector<uint32_t> programmedSectors;
+
+// Emulate flash erase and program on the faked flash, recording the sectors written
+static void setupFlash(MockPicoSdk &mockPicoSdk)
+{
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(_,_))
+      .Times(AnyNumber())
+      .WillRepeatedly(Invoke(
+         [](uint32_t flash_offs, size_t count) {
+            ASSERT_EQ(flash_offs % FLASH_SECTOR_SIZE, 0);
+            ASSERT_LE(flash_offs + count, sizeof(dummyFlash));
+
+            for (uint32_t offs = flash_offs; offs < flash_offs + count; offs += FLASH_SECTOR_SIZE)
+            {
+               erasedSectors.push_back(offs / FLASH_SECTOR_SIZE);
+            }
+
+            memset(&dummyFlash[flash_offs], 0xFF, count);
+         }
+   ));
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_))
+      .Times(AnyNumber())
+      .WillRepeatedly(Invoke(
+         [](uint32_t flash_offs, const uint8_t *data, size_t count) {
+            ASSERT_EQ(flash_offs % FLASH_SECTOR_SIZE, 0);
+            ASSERT_EQ(count, FLASH_SECTOR_SIZE);
+            ASSERT_LE(flash_offs + count, sizeof(dummyFlash));
+
+            programmedSectors.push_back(flash_offs / FLASH_SECTOR_SIZE);
+
+            // Programming can only clear bits
+            for (size_t i = 0; i < count; i++)
+            {
+               dummyFlash[flash_offs + i] &= data[i];
+            }
+         }
+   ));
+
+   dummyFlashInit();
+}
+
+// Clear the record of sectors written
+static void clearSectors(void)
+{
+   erasedSectors.clear();
+   programmedSectors.clear();
+}
+
+// Configure an event table that extends well into the second sector
+static void setupConfig(CBUSConfig &config)
+{
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 1000; // Maximum number of events, 5000 bytes
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+   config.begin();
+}
+
+// Build the event stored at an index
+static EVENT_INFO_t makeEvent(uint16_t index)
+{
+   return EVENT_INFO_t {.nodeNumber = static_cast<uint16_t>(500 + (index % 7)), .eventNumber = static_cast<uint16_t>(index + 1000)};
+}
+
+//-----------------------------------------------------------------------------
+
+// Events beyond the first sector are written to, and read back from, the second sector
+TEST(CBUSConfigSectors, fillBeyondFirstSector)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   setupFlash(mockPicoSdk);
+
+   CBUSConfig config;
+   setupConfig(config);
+   clearSectors();
+
+   for (uint16_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      uint16_t eventNo = config.findEventSpace();
+      ASSERT_EQ(eventNo, ev);
+
+      EVENT_INFO_t evInfo = makeEvent(ev);
+      config.writeEvent(eventNo, evInfo, false);
+   }
+
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS);
+
+   // Nothing written until the changes are committed, then each sector is programmed once,
+   // flash was erased so no erase is needed
+   ASSERT_TRUE(programmedSectors.empty());
+   config.commitChanges();
+   ASSERT_EQ(programmedSectors, vector<uint32_t>({0, 1}));
+   ASSERT_TRUE(erasedSectors.empty());
+
+   // Nothing left to write
+   clearSectors();
+   config.commitChanges();
+   ASSERT_TRUE(programmedSectors.empty());
+
+   // The event table is rebuilt from flash, including the event that spans both sectors
+   CBUSConfig reloaded;
+   setupConfig(reloaded);
+
+   ASSERT_EQ(reloaded.numEvents(), config.EE_MAX_EVENTS);
+
+   for (uint16_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      EVENT_INFO_t evInfo = makeEvent(ev);
+      ASSERT_EQ(reloaded.findExistingEvent(evInfo.nodeNumber, evInfo.eventNumber), ev);
+   }
+
+   // Event 815 starts at the last byte of the first sector
+   EVENT_INFO_t evInfo {};
+   reloaded.readEvent(815, evInfo);
+   ASSERT_EQ(evInfo.nodeNumber, makeEvent(815).nodeNumber);
+   ASSERT_EQ(evInfo.eventNumber, makeEvent(815).eventNumber);
+}
+
+// Only the sectors holding modified data are erased and programmed
+TEST(CBUSConfigSectors, dirtySectors)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   setupFlash(mockPicoSdk);
+
+   CBUSConfig config;
+   setupConfig(config);
+
+   EVENT_INFO_t evInfo;
+
+   // An event in the first sector only programs the first sector
+   clearSectors();
+   evInfo = makeEvent(10);
+   config.writeEvent(10, evInfo);
+   ASSERT_EQ(programmedSectors, vector<uint32_t>({0}));
+   ASSERT_TRUE(erasedSectors.empty());
+
+   // An event in the second sector only programs the second sector
+   clearSectors();
+   evInfo = makeEvent(900);
+   config.writeEvent(900, evInfo);
+   ASSERT_EQ(programmedSectors, vector<uint32_t>({1}));
+   ASSERT_TRUE(erasedSectors.empty());
+
+   // An event spanning the sectors programs both
+   clearSectors();
+   evInfo = makeEvent(815);
+   config.writeEvent(815, evInfo);
+   ASSERT_EQ(programmedSectors, vector<uint32_t>({0, 1}));
+   ASSERT_TRUE(erasedSectors.empty());
+
+   // Clearing an event sets bits, so only its sector is erased before it is programmed
+   clearSectors();
+   config.clearEventEEPROM(900);
+   ASSERT_EQ(erasedSectors, vector<uint32_t>({1}));
+   ASSERT_EQ(programmedSectors, vector<uint32_t>({1}));
+
+   // Rewriting an unchanged event writes nothing
+   clearSectors();
+   evInfo = makeEvent(10);
+   config.writeEvent(10, evInfo);
+   ASSERT_TRUE(programmedSectors.empty());
+
+   // The first sector is untouched by the erase of the second
+   CBUSConfig reloaded;
+   setupConfig(reloaded);
+
+   ASSERT_EQ(reloaded.numEvents(), 2);
+   evInfo = makeEvent(10);
+   ASSERT_EQ(reloaded.findExistingEvent(evInfo.nodeNumber, evInfo.eventNumber), 10);
+   evInfo = makeEvent(815);
+   ASSERT_EQ(reloaded.findExistingEvent(evInfo.nodeNumber, evInfo.eventNumber), 815);
+   evInfo = makeEvent(900);
+   ASSERT_EQ(reloaded.findExistingEvent(evInfo.nodeNumber, evInfo.eventNumber), reloaded.EE_MAX_EVENTS);
+}
+
+int main(int argc, char **argv)
+{
+   // The following line must be executed to initialize Google Mock
+   // (and Google Test) before running the tests.
+   ::testing::InitGoogleMock(&argc, argv);
+   return RUN_ALL_TESTS();
+}
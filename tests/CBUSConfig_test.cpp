@@ -231,6 +231,403 @@ TEST(CBUSConfig, events)
    ASSERT_EQ(config.getEvTableEntry(config.EE_MAX_EVENTS + 1), 0);
 }
 
+TEST(CBUSConfig, eventIndex)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   CBUSConfig config;
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Set sizing params
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 64;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   // Initialize defaults
+   config.begin();
+
+   // Fill the table, the index is maintained by writeEvent alone
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      EVENT_INFO_t evInfo {.nodeNumber = static_cast<uint16_t>(ev & 0x3), .eventNumber = static_cast<uint16_t>(ev * 257)};
+      config.writeEvent(ev, evInfo, false);
+   }
+
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      ASSERT_EQ(config.findExistingEvent(ev & 0x3, ev * 257), ev);
+   }
+
+   // Learnt events always pass the prefilter, most others are rejected by it
+   uint16_t passed = 0;
+
+   for (uint16_t en = 0; en < 1000; en++)
+   {
+      if (config.mayHaveEvent(0x10, en))
+      {
+         ++passed;
+      }
+   }
+
+   ASSERT_LT(passed, 150);
+
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      ASSERT_TRUE(config.mayHaveEvent(ev & 0x3, ev * 257));
+   }
+
+   // Events not learnt, including the unused event key, are not found
+   ASSERT_EQ(config.findExistingEvent(0x4, 0x1), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.findExistingEvent(0xFFFF, 0xFFFF), config.EE_MAX_EVENTS);
+
+   // Unlearn every third event, remaining events must still be reachable
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev += 3)
+   {
+      config.clearEventEEPROM(ev, false);
+   }
+
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      uint8_t expected = (ev % 3 == 0) ? config.EE_MAX_EVENTS : ev;
+      ASSERT_EQ(config.findExistingEvent(ev & 0x3, ev * 257), expected);
+   }
+
+   // Event count, free slots and hash collisions are maintained incrementally
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS - 22);
+   ASSERT_EQ(config.findEventSpace(), 0);
+
+   bool bCollisions = false;
+
+   for (uint8_t i = 0; i < config.EE_MAX_EVENTS; i++)
+   {
+      for (uint8_t j = i + 1; j < config.EE_MAX_EVENTS; j++)
+      {
+         if (config.getEvTableEntry(i) != 0 && config.getEvTableEntry(i) == config.getEvTableEntry(j))
+         {
+            bCollisions = true;
+         }
+      }
+   }
+
+   ASSERT_EQ(config.check_hash_collisions(), bCollisions);
+
+   // Overwrite a slot with a different event
+   EVENT_INFO_t evInfo {.nodeNumber = 100, .eventNumber = 200};
+   config.writeEvent(1, evInfo, false);
+   ASSERT_EQ(config.findExistingEvent(100, 200), 1);
+   ASSERT_EQ(config.findExistingEvent(1, 257), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS - 22);
+
+   // Freed slots are reused lowest first
+   evInfo = {.nodeNumber = 100, .eventNumber = 201};
+   config.writeEvent(config.findEventSpace(), evInfo, false);
+   ASSERT_EQ(config.findExistingEvent(100, 201), 0);
+   ASSERT_EQ(config.findEventSpace(), 3);
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS - 21);
+
+   // Rebuilding from storage gives the same answers
+   config.makeEvHashTable();
+   ASSERT_EQ(config.findExistingEvent(100, 200), 1);
+   ASSERT_EQ(config.findExistingEvent(2, 2 * 257), 2);
+   ASSERT_EQ(config.findExistingEvent(0, 0), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS - 21);
+
+   // Clearing all events empties the index
+   config.clearEventsEEPROM();
+   ASSERT_EQ(config.findExistingEvent(100, 200), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.findExistingEvent(2, 2 * 257), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.numEvents(), 0);
+   ASSERT_EQ(config.findEventSpace(), 0);
+   ASSERT_FALSE(config.check_hash_collisions());
+
+   // Prefilter is rebuilt as events are unlearnt, so nothing passes it
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      ASSERT_FALSE(config.mayHaveEvent(ev & 0x3, ev * 257));
+   }
+}
+
+TEST(CBUSConfig, shortEventTable)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   CBUSConfig config;
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Set sizing params
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 64;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   // Enable the short event table before the event table is loaded
+   ASSERT_FALSE(config.getShortEventTable());
+   ASSERT_TRUE(config.setShortEventTable(true));
+   ASSERT_TRUE(config.getShortEventTable());
+
+   config.begin();
+
+   // Alternate short and long events, short event numbers spread across the bitmap
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      EVENT_INFO_t evInfo {.nodeNumber = static_cast<uint16_t>((ev % 2) ? 0 : 100), .eventNumber = static_cast<uint16_t>(ev * 1021)};
+      config.writeEvent(ev, evInfo, false);
+   }
+
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      ASSERT_EQ(config.findExistingEvent((ev % 2) ? 0 : 100, ev * 1021), ev);
+      ASSERT_TRUE(config.mayHaveEvent((ev % 2) ? 0 : 100, ev * 1021));
+   }
+
+   // Short events not learnt are rejected exactly
+   ASSERT_EQ(config.findExistingEvent(0, 1), config.EE_MAX_EVENTS);
+   ASSERT_FALSE(config.mayHaveEvent(0, 1));
+   ASSERT_EQ(config.findExistingEvent(0, 0), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.findExistingEvent(0, 0xFFFF), config.EE_MAX_EVENTS);
+
+   // Unlearn some short events, the others keep their slots
+   config.clearEventEEPROM(1, false);
+   config.clearEventEEPROM(33, false);
+   ASSERT_EQ(config.findExistingEvent(0, 1021), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.findExistingEvent(0, 33 * 1021), config.EE_MAX_EVENTS);
+
+   for (uint8_t ev = 3; ev < config.EE_MAX_EVENTS; ev += 2)
+   {
+      if (ev != 33)
+      {
+         ASSERT_EQ(config.findExistingEvent(0, ev * 1021), ev);
+      }
+   }
+
+   // Move a short event to a new slot
+   EVENT_INFO_t evInfo {.nodeNumber = 0, .eventNumber = 3 * 1021};
+   config.clearEventEEPROM(3, false);
+   config.writeEvent(1, evInfo, false);
+   ASSERT_EQ(config.findExistingEvent(0, 3 * 1021), 1);
+
+   // Disable, and lookups fall back to the event index
+   ASSERT_TRUE(config.setShortEventTable(false));
+   ASSERT_FALSE(config.getShortEventTable());
+   ASSERT_EQ(config.findExistingEvent(0, 3 * 1021), 1);
+   ASSERT_EQ(config.findExistingEvent(0, 5 * 1021), 5);
+
+   // Enabling with events stored loads them into the table
+   ASSERT_TRUE(config.setShortEventTable(true));
+   ASSERT_EQ(config.findExistingEvent(0, 3 * 1021), 1);
+   ASSERT_EQ(config.findExistingEvent(0, 5 * 1021), 5);
+   ASSERT_EQ(config.findExistingEvent(0, 7 * 1021), 7);
+   ASSERT_EQ(config.findExistingEvent(0, 1021), config.EE_MAX_EVENTS);
+
+   // Clearing all events empties the table
+   config.clearEventsEEPROM();
+   config.clearEvHashTable();
+   ASSERT_EQ(config.findExistingEvent(0, 5 * 1021), config.EE_MAX_EVENTS);
+   ASSERT_FALSE(config.mayHaveEvent(0, 5 * 1021));
+}
+
+TEST(CBUSConfig, evMirror)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   CBUSConfig config;
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Set sizing params
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 3;       // Number of Event Variables per event
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   // Mirror the first two EVs, loaded with the event table
+   ASSERT_TRUE(config.setEVMirror(2));
+   ASSERT_EQ(config.getEVMirror(), 0);
+   ASSERT_EQ(config.getEventEVs(0), nullptr);
+
+   config.begin();
+
+   ASSERT_EQ(config.getEVMirror(), 2);
+
+   for (uint8_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      config.writeEventEV(ev, 1, ev + 10);
+      config.writeEventEV(ev, 2, ev + 20);
+      config.writeEventEV(ev, 3, ev + 30);
+   }
+
+   // Mirrored EVs are served from RAM, others from storage
+   const uint32_t ev4 = config.EE_EVENTS_START + (4 * config.EE_BYTES_PER_EVENT) + 3;
+   config.writeEEPROM(ev4 + 1, 0x55);
+   config.writeEEPROM(ev4 + 3, 0x66);
+
+   ASSERT_EQ(config.getEventEVval(4, 1), 14);
+   ASSERT_EQ(config.getEventEVval(4, 2), 24);
+   ASSERT_EQ(config.getEventEVval(4, 3), 0x66);
+
+   const uint8_t *evs = config.getEventEVs(5);
+   ASSERT_NE(evs, nullptr);
+   ASSERT_EQ(evs[0], 15);
+   ASSERT_EQ(evs[1], 25);
+   ASSERT_EQ(config.getEventEVs(config.EE_MAX_EVENTS), nullptr);
+
+   // Reloading the mirror picks up the storage contents
+   ASSERT_TRUE(config.setEVMirror(8));
+   ASSERT_EQ(config.getEVMirror(), config.EE_NUM_EVS);
+   ASSERT_EQ(config.getEventEVval(4, 1), 0x55);
+   ASSERT_EQ(config.getEventEVval(4, 3), 0x66);
+
+   // Disable the mirror
+   ASSERT_TRUE(config.setEVMirror(0));
+   ASSERT_EQ(config.getEVMirror(), 0);
+   ASSERT_EQ(config.getEventEVs(5), nullptr);
+   ASSERT_EQ(config.getEventEVval(5, 2), 25);
+}
+
+TEST(CBUSConfig, largeEventTable)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   CBUSConfig config;
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Set sizing params, more events than an 8-bit index can address
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 600;  // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   ASSERT_TRUE(config.setShortEventTable(true));
+   ASSERT_TRUE(config.setEVMirror(1));
+
+   config.begin();
+
+   for (uint16_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      uint16_t eventNo = config.findEventSpace();
+      ASSERT_EQ(eventNo, ev);
+
+      EVENT_INFO_t evInfo {.nodeNumber = static_cast<uint16_t>((ev % 3) ? 0 : 500), .eventNumber = static_cast<uint16_t>(ev + 1000)};
+      config.writeEvent(eventNo, evInfo, false);
+      config.writeEventEV(eventNo, 1, static_cast<uint8_t>(ev));
+   }
+
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.findEventSpace(), config.EE_MAX_EVENTS);
+
+   // Rebuild from storage, all events keep their 16-bit indices
+   config.makeEvHashTable();
+
+   for (uint16_t ev = 0; ev < config.EE_MAX_EVENTS; ev++)
+   {
+      ASSERT_EQ(config.findExistingEvent((ev % 3) ? 0 : 500, ev + 1000), ev);
+      ASSERT_EQ(config.getEventEVval(ev, 1), static_cast<uint8_t>(ev));
+   }
+
+   // Unlearn an event beyond the 8-bit index range and reuse its slot
+   config.clearEventEEPROM(400, false);
+   ASSERT_EQ(config.findExistingEvent(0, 1400), config.EE_MAX_EVENTS);
+   ASSERT_EQ(config.findEventSpace(), 400);
+   ASSERT_EQ(config.numEvents(), config.EE_MAX_EVENTS - 1);
+
+   EVENT_INFO_t evInfo {.nodeNumber = 0, .eventNumber = 7};
+   config.writeEvent(400, evInfo, true);
+   ASSERT_EQ(config.findExistingEvent(0, 7), 400);
+
+   evInfo = {};
+   config.readEvent(599, evInfo);
+   ASSERT_EQ(evInfo.nodeNumber, 0);
+   ASSERT_EQ(evInfo.eventNumber, 1599);
+}
+
+TEST(CBUSConfig, findNextEvent)
+{
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   CBUSConfig config;
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Set sizing params, a sparse table spanning several words of the free map
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 100;  // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.begin();
+
+   // Empty table
+   ASSERT_EQ(config.findNextEvent(0), config.EE_MAX_EVENTS);
+
+   for (uint16_t ev : {3, 31, 32, 95, 99})
+   {
+      EVENT_INFO_t evInfo {.nodeNumber = 500, .eventNumber = ev};
+      config.writeEvent(ev, evInfo, false);
+   }
+
+   ASSERT_EQ(config.findNextEvent(0), 3);
+   ASSERT_EQ(config.findNextEvent(3), 3);
+   ASSERT_EQ(config.findNextEvent(4), 31);
+   ASSERT_EQ(config.findNextEvent(32), 32);
+   ASSERT_EQ(config.findNextEvent(33), 95);
+   ASSERT_EQ(config.findNextEvent(96), 99);
+   ASSERT_EQ(config.findNextEvent(config.EE_MAX_EVENTS), config.EE_MAX_EVENTS);
+
+   // Nothing after the last stored event, slots beyond the table are never returned
+   config.clearEventEEPROM(99, false);
+   ASSERT_EQ(config.findNextEvent(96), config.EE_MAX_EVENTS);
+
+   // Every stored event is visited in order
+   uint16_t visited = 0;
+
+   for (uint16_t ev = config.findNextEvent(0); ev < config.EE_MAX_EVENTS; ev = config.findNextEvent(ev + 1))
+   {
+      ASSERT_NE(config.getEvTableEntry(ev), 0);
+      visited++;
+   }
+
+   ASSERT_EQ(visited, config.numEvents());
+}
+
 TEST(CBUSConfig, nodeVars)
 {
    MockPicoSdk mockPicoSdk;
@@ -448,6 +845,19 @@ TEST(CBUSConfig, i2cAPI)
    config.readBytesEEPROM(0, NUM_BYTES, readBytes);
 
    ASSERT_EQ(memcmp(readBytes, writeBytes, NUM_BYTES), 0);
+
+   // Event lookups are served from the RAM key cache, the EEPROM is not read
+   EXPECT_CALL(mockPicoSdk, i2c_read_blocking_until(_,_,_,_,_,_)).Times(0);
+
+   EVENT_INFO_t evInfo {.nodeNumber = 10, .eventNumber = 1};
+   config.writeEvent(2, evInfo);
+   ASSERT_EQ(config.findExistingEvent(10, 1), 2);
+   ASSERT_EQ(config.findExistingEvent(10, 2), config.EE_MAX_EVENTS);
+
+   evInfo = {};
+   config.readEvent(2, evInfo);
+   ASSERT_EQ(evInfo.nodeNumber, 10);
+   ASSERT_EQ(evInfo.eventNumber, 1);
 }
 
 int main(int argc, char **argv)
@@ -0,0 +1,251 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// CBUS Mocks
+#include "CBUS_mock.h"
+#include "CANTransport_mock.h"
+
+#include "CBUS.h"
+#include "CBUSConfig.h"
+#include "CBUSParams.h"
+#include "CBUSMulticore.h"
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "mocklib.h"
+
+using namespace std;
+
+using testing::_;
+using testing::AnyNumber;
+using testing::Return;
+
+// Application callbacks on core0
+
+uint8_t numFrames;
+uint8_t numEvents;
+uint16_t lastIndex;
+uint8_t lastEvVal;
+bool lastOn;
+
+void frameCallback(CANFrame & /* msg */)
+{
+   numFrames++;
+}
+
+void eventCallbackEx(uint16_t index, const CANFrame & /* msg */, bool ison, uint8_t evval)
+{
+   numEvents++;
+   lastIndex = index;
+   lastOn = ison;
+   lastEvVal = evval;
+}
+
+static constexpr const uint8_t ourNNHi {0x12};
+static constexpr const uint8_t ourNNLo {0x34};
+
+static constexpr const uint8_t othNNHi {0x01};
+static constexpr const uint8_t othNNLo {0x02};
+
+//-----------------------------------------------------------------------------
+
+TEST(CBUSMulticore, coreQueue)
+{
+   CBUSCoreQueue<uint32_t, 4> queue;
+   uint32_t item;
+
+   ASSERT_FALSE(queue.available());
+   ASSERT_FALSE(queue.get(item));
+
+   for (uint32_t i = 0; i < 4; i++)
+   {
+      ASSERT_TRUE(queue.put(i));
+   }
+
+   // Full
+   ASSERT_FALSE(queue.put(4));
+
+   // Peek leaves the item queued
+   ASSERT_TRUE(queue.peek(item));
+   ASSERT_EQ(item, 0);
+   ASSERT_TRUE(queue.peek(item));
+   ASSERT_EQ(item, 0);
+   queue.pop();
+
+   // Wraps around
+   ASSERT_TRUE(queue.put(4));
+
+   for (uint32_t i = 1; i < 5; i++)
+   {
+      ASSERT_TRUE(queue.get(item));
+      ASSERT_EQ(item, i);
+   }
+
+   ASSERT_FALSE(queue.available());
+}
+
+TEST(CBUSMulticore, bridge)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   config.begin();
+
+   CBUSMock cbus(config);
+   cbus.indicateFLiMMode(true);
+
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+   EXPECT_CALL(cbus, sendMessageImpl(_,_,_,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Bridge with application handlers registered on core0
+   CBUSMulticore bridge(cbus, config);
+
+   const uint8_t qnnOpcodes[] = {OPC_QNN};
+   bridge.setFrameHandler(frameCallback, CBUSbase::makeOpcodeMask(qnnOpcodes, sizeof(qnnOpcodes)));
+   bridge.setEventHandlerExCB(eventCallbackEx);
+
+   // Teach an event on core1
+   canRxFrames.push(CANFrame{.len=3, .data{OPC_NNLRN, ourNNHi, ourNNLo}});
+   canRxFrames.push(CANFrame{.len=7, .data{OPC_EVLRN, othNNHi, othNNLo, 0x00, 0x01, 0x01, 0x33}});
+   canRxFrames.push(CANFrame{.len=3, .data{OPC_NNULN, ourNNHi, ourNNLo}});
+   bridge.runStack();
+
+   ASSERT_EQ(canTxFrames.size(), 1);
+   ASSERT_EQ(canTxFrames.front().data[0], OPC_WRACK);
+   canTxFrames.pop();
+
+   // Nothing for the application yet
+   ASSERT_FALSE(bridge.available());
+
+   // Event and subscribed frame received on core1, delivered on core0
+   canRxFrames.push(CANFrame{.len=5, .data{OPC_ACON, othNNHi, othNNLo, 0x00, 0x01}});
+   canRxFrames.push(CANFrame{.len=1, .data{OPC_QNN}});
+   bridge.runStack();
+
+   ASSERT_TRUE(bridge.available());
+   ASSERT_EQ(numEvents, 0);
+   ASSERT_EQ(bridge.process(), 2);
+   ASSERT_EQ(numEvents, 1);
+   ASSERT_EQ(numFrames, 1);
+   ASSERT_EQ(lastIndex, 0);
+   ASSERT_TRUE(lastOn);
+   ASSERT_EQ(lastEvVal, 0x33);
+
+   // QNN answered by the stack
+   ASSERT_EQ(canTxFrames.size(), 1);
+   ASSERT_EQ(canTxFrames.front().data[0], OPC_PNN);
+   canTxFrames.pop();
+
+   // Frames sent by the application are transmitted on core1
+   CANFrame msg = {.len=5, .data{OPC_ACOF, ourNNHi, ourNNLo, 0x00, 0x02}};
+   ASSERT_TRUE(bridge.sendMessage(msg));
+   ASSERT_EQ(canTxFrames.size(), 0);
+
+   // Transmit refused, frame kept for the next iteration
+   canTxReturn = false;
+   bridge.runStack();
+   ASSERT_EQ(canTxFrames.size(), 0);
+
+   canTxReturn = true;
+   bridge.runStack();
+   ASSERT_EQ(canTxFrames.size(), 1);
+   ASSERT_EQ(canTxFrames.front().data[0], OPC_ACOF);
+   canTxFrames.pop();
+
+   // Application queue full, notifications dropped
+   for (uint32_t i = 0; i < CORE_QUEUE_SLOTS + 2; i++)
+   {
+      canRxFrames.push(CANFrame{.len=1, .data{OPC_QNN}});
+      bridge.runStack();
+   }
+
+   ASSERT_EQ(bridge.getNumDropped(), 2);
+   ASSERT_EQ(bridge.process(), CORE_QUEUE_SLOTS);
+   ASSERT_EQ(numFrames, 1 + CORE_QUEUE_SLOTS);
+   ASSERT_FALSE(bridge.available());
+}
+
+int main(int argc, char **argv)
+{
+   // The following line must be executed to initialize Google Mock
+   // (and Google Test) before running the tests.
+   ::testing::InitGoogleMock(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+/*
+   CBUS Module Library - RasberryPi Pico SDK port
+   Copyright (c) Kevin Kimber 2024
+
+   Based on work by Duncan Greenwood
+   Copyright (c) Duncan Greenwood 2017 (duncan_greenwood@hotmail.com)
+
+   This work is licensed under the:
+      Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+   To view a copy of this license, visit:
+      http://creativecommons.org/licenses/by-nc-sa/4.0/
+   or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+   License summary:
+    You are free to:
+      Share, copy and redistribute the material in any medium or format
+      Adapt, remix, transform, and build upon the material
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+    Attribution : You must give appropriate credit, provide a link to the license,
+                  and indicate if changes were made. You may do so in any reasonable manner,
+                  but not in any way that suggests the licensor endorses you or your use.
+
+    NonCommercial : You may not use the material for commercial purposes. **(see note below)
+
+    ShareAlike : If you remix, transform, or build upon the material, you must distribute
+                 your contributions under the same license as the original.
+
+    No additional restrictions : You may not apply legal terms or technological measures that
+                                 legally restrict others from doing anything the license permits.
+
+   ** For commercial use, please contact the original copyright holder(s) to agree licensing terms
+
+    This software is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE
+
+*/
+
+#include "CBUSRateLimiter.h"
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <pico/stdlib.h>
+
+#include "mocklib.h"
+
+using testing::ReturnPointee;
+
+// Unlimited by default
+TEST(CBUSRateLimiter, unlimited)
+{
+   CBUSRateLimiter limiter;
+
+   for (uint8_t priority = 0; priority < RATE_NUM_PRIORITIES; priority++)
+   {
+      ASSERT_EQ(limiter.getRate(priority), 0);
+
+      for (auto i = 0; i < 100; i++)
+      {
+         ASSERT_TRUE(limiter.tryConsume(priority));
+      }
+
+      ASSERT_EQ(limiter.getNumDeferred(priority), 0);
+   }
+
+   // Out of range priority is never limited
+   limiter.setRate(RATE_NUM_PRIORITIES, 1);
+   ASSERT_TRUE(limiter.tryConsume(RATE_NUM_PRIORITIES));
+}
+
+// Token bucket refill and burst
+TEST(CBUSRateLimiter, tokenBucket)
+{
+   uint64_t sysTime = 0ULL; // microseconds
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(ReturnPointee(&sysTime));
+
+   CBUSRateLimiter limiter;
+
+   // 100 frames per second, bursts of 3, on the lowest priority
+   limiter.setRate(3, 100, 3);
+   ASSERT_EQ(limiter.getRate(3), 100);
+
+   // Bucket starts full
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_FALSE(limiter.tryConsume(3));
+   ASSERT_EQ(limiter.getNumDeferred(3), 1);
+
+   // Other priorities are unaffected
+   ASSERT_TRUE(limiter.tryConsume(0));
+
+   // A token every 10ms, a retried frame is only counted as deferred once
+   sysTime += 9999;
+   ASSERT_FALSE(limiter.tryConsume(3));
+   ASSERT_EQ(limiter.getNumDeferred(3), 1);
+
+   sysTime += 1;
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_FALSE(limiter.tryConsume(3));
+   ASSERT_EQ(limiter.getNumDeferred(3), 2);
+
+   // Refill is capped at the burst size
+   sysTime += 1000000;
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_FALSE(limiter.tryConsume(3));
+
+   // Removing the limit
+   limiter.setRate(3, 0);
+   ASSERT_TRUE(limiter.tryConsume(3));
+   ASSERT_EQ(limiter.getNumDeferred(3), 3);
+}
+
+// Slow rates accumulate partial tokens
+TEST(CBUSRateLimiter, slowRate)
+{
+   uint64_t sysTime = 0ULL; // microseconds
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(ReturnPointee(&sysTime));
+
+   CBUSRateLimiter limiter;
+
+   // 2 frames per second
+   limiter.setRate(0, 2);
+   ASSERT_TRUE(limiter.tryConsume(0));
+
+   // Polled frequently, a token is available after 500ms
+   for (auto i = 0; i < 499; i++)
+   {
+      sysTime += 1000;
+      ASSERT_FALSE(limiter.tryConsume(0));
+   }
+
+   sysTime += 1000;
+   ASSERT_TRUE(limiter.tryConsume(0));
+   ASSERT_EQ(limiter.getNumDeferred(0), 1);
+}
+
+// Time until the next token, for sleeping whilst frames are deferred
+TEST(CBUSRateLimiter, timeToToken)
+{
+   uint64_t sysTime = 0ULL; // microseconds
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   EXPECT_CALL(mockPicoSdk, get_absolute_time()).WillRepeatedly(ReturnPointee(&sysTime));
+
+   CBUSRateLimiter limiter;
+
+   // Unlimited priorities never wait
+   ASSERT_EQ(limiter.getTimeToToken(1), 0);
+   ASSERT_EQ(limiter.getTimeToToken(RATE_NUM_PRIORITIES), 0);
+
+   // 100 frames per second, a token is available until it is taken
+   limiter.setRate(1, 100);
+   ASSERT_EQ(limiter.getTimeToToken(1), 0);
+   ASSERT_TRUE(limiter.tryConsume(1));
+   ASSERT_EQ(limiter.getTimeToToken(1), 10000);
+
+   // Partial tokens, and time not yet converted to tokens, count towards the wait
+   sysTime += 2500;
+   ASSERT_EQ(limiter.getTimeToToken(1), 7500);
+
+   sysTime += 5;
+   ASSERT_EQ(limiter.getTimeToToken(1), 7495);
+
+   sysTime += 7495;
+   ASSERT_EQ(limiter.getTimeToToken(1), 0);
+   ASSERT_TRUE(limiter.tryConsume(1));
+   ASSERT_EQ(limiter.getNumDeferred(1), 0);
+}
+
+int main(int argc, char **argv)
+{
+   // The following line must be executed to initialize Google Mock
+   // (and Google Test) before running the tests.
+   ::testing::InitGoogleMock(&argc, argv);
+   return RUN_ALL_TESTS();
+}
@@ -42,6 +42,8 @@
 
 // CBUS Mocks
 #include "CBUS_mock.h"
+#include "CBUSGridConnect.h"
+#include "CANTransport_mock.h"
 
 #include "CBUS.h"
 #include "CBUSLED.h"
@@ -64,98 +66,22 @@ using testing::AnyNumber;
 using testing::Return;
 using testing::InSequence;
 
-//-----------------------------------------------------------------------------
-// Mock CAN transport, saves all frames posted for transmission to a vector
-
-queue<CANFrame> canRxFrames;  // Frames received off the wire into CBUS
-queue<CANFrame> canTxFrames;  // Frames generated by CBUS to be sent to the wire
-
-// Add a frame to the mock to be processed by CBUS
-void mockAddRxFrame(CANFrame& frame)
-{
-   canRxFrames.push(frame);
-}
-
-// Are there any frames to be received off the wire
-bool mockCanRxAvailable(void)
-{
-   return !canRxFrames.empty();
-}
-
-// Retrieve the next frame off the wire to be processed by CBUS
-CANFrame mockCanRx(void)
-{
-   if (canRxFrames.size() > 0)
-   {
-      CANFrame frame = canRxFrames.front();
-      canRxFrames.pop();
-      return frame;
-   }
-   else
-   { 
-      // THIS SHOULD REALY BE AN ASSERT!
-      CANFrame frame;
-      return frame;
-   }
-}
-void clearRxFrames(void)
-{
-   while (!canRxFrames.empty())
-   {
-      canRxFrames.pop();
-   }
-}
-
-// Test for frames and retrieve first frame sent by CBUS
-bool mockGetCanTx(CANFrame& msg)
-{
-   // Are there any frames transmitted?
-   if (!canTxFrames.empty())
-   {
-      // Retreive first frame queued
-      msg = canTxFrames.front();
-      canTxFrames.pop();
-      return true;
-   }
-
-   // No frames available
-   return false;
-}
-
-// Capture frames transmitted by CBUS (send to the wire)
-bool canTxReturn {true};
-bool mockCanTx(CANFrame &msg, bool rtr, bool ext, uint8_t priority)
-{
-   msg.rtr = rtr;
-   msg.ext = ext;
-   canTxFrames.push(msg);
-   return canTxReturn;
-}
-
-void clearTxFrames(void)
-{
-   while (!canTxFrames.empty())
-   {
-      canTxFrames.pop();
-   }
-}
-
 // Callback handler mock
 struct CallbackMock
 {
-   MOCK_METHOD(void, eventCallback, (uint8_t, const CANFrame &));
-   MOCK_METHOD(void, eventCallbackEx, (uint8_t, const CANFrame &, bool, uint8_t ));
+   MOCK_METHOD(void, eventCallback, (uint16_t, const CANFrame &));
+   MOCK_METHOD(void, eventCallbackEx, (uint16_t, const CANFrame &, bool, uint8_t ));
    MOCK_METHOD(void, frameCallback, (CANFrame &));
 };
 
 CallbackMock* pCallbackMock;
 
-void eventCallback(uint8_t index, const CANFrame &msg)
+void eventCallback(uint16_t index, const CANFrame &msg)
 {
    pCallbackMock->eventCallback(index, msg);
 }
 
-void eventCallbackEx(uint8_t index, const CANFrame &msg, bool ison, uint8_t evval)
+void eventCallbackEx(uint16_t index, const CANFrame &msg, bool ison, uint8_t evval)
 {
    pCallbackMock->eventCallbackEx(index, msg, ison, evval);
 }
@@ -165,6 +91,25 @@ void frameCallback(CANFrame &msg)
    pCallbackMock->frameCallback(msg);
 }
 
+// CBUS mock receiving frames through a queue, as a CAN transport would
+class CBUSQueueMock : public CBUSMock
+{
+public:
+   CBUSQueueMock(CBUSConfig& config) : CBUSMock(config) {};
+
+   uint8_t getMessages(CANFrame *out, uint8_t max) override
+   {
+      return m_queue.getMessages(out, max);
+   }
+
+   CBUSCircularBuffer *getRxQueue(void) override
+   {
+      return &m_queue;
+   }
+
+   CBUSCircularBufferT<16> m_queue;
+};
+
 static constexpr const uint8_t ourNNHi {0x12};
 static constexpr const uint8_t ourNNLo {0x34};
 
@@ -936,6 +881,47 @@ TEST(CBUS, testFLiM_Events)
    ASSERT_EQ(canTxFrame.data[2], ourNNLo);
    ASSERT_EQ(canTxFrame.data[3], config.EE_MAX_EVENTS);
 
+   // Read all events, the responses are streamed over several runs
+   canRxFrame = {.len=3, .data{OPC_NERD, ourNNHi, ourNNLo}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+
+   ASSERT_TRUE(cbus.streamActive());
+
+   for (uint8_t i=0; i < STREAM_BURST_LEN; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_ENRSP);
+      ASSERT_EQ(canTxFrame.data[5], i);
+      ASSERT_EQ(canTxFrame.data[7], i);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+
+   // Transmit refused, the stream waits without blocking
+   canTxReturn = false;
+   cbus.process();
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+   canTxReturn = true;
+
+   // Remaining responses
+   while (cbus.streamActive())
+   {
+      cbus.process();
+   }
+
+   for (uint8_t i=STREAM_BURST_LEN; i < config.EE_MAX_EVENTS; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_ENRSP);
+      ASSERT_EQ(canTxFrame.data[1], ourNNHi);
+      ASSERT_EQ(canTxFrame.data[2], ourNNLo);
+      ASSERT_EQ(canTxFrame.data[7], i);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+
+   uint32_t eventsReceived = cbus.getNumEventsReceived();
+   uint32_t eventsRejected = cbus.getNumEventsRejected();
+
    // Send ACON for each event in turn
    for (uint8_t i=0; i < config.EE_MAX_EVENTS; i++)
    {
@@ -944,6 +930,21 @@ TEST(CBUS, testFLiM_Events)
       cbus.process();
    }
 
+   // Learnt events always pass the prefilter
+   ASSERT_EQ(cbus.getNumEventsReceived(), eventsReceived + config.EE_MAX_EVENTS);
+   ASSERT_EQ(cbus.getNumEventsRejected(), eventsRejected);
+
+   // Most events that haven't been learnt are rejected by the prefilter
+   for (uint8_t i=0; i < 100; i++)
+   {
+      canRxFrame = {.len=5, .data{OPC_ACON, othNNHi, othNNLo, 0x80, i}};
+      mockAddRxFrame(canRxFrame);
+      cbus.process();
+   }
+
+   ASSERT_EQ(cbus.getNumEventsReceived(), eventsReceived + config.EE_MAX_EVENTS + 100);
+   ASSERT_GE(cbus.getNumEventsRejected(), eventsRejected + 80);
+
    // Send ACOFF for each event in turn
    for (uint8_t i=config.EE_MAX_EVENTS; i <= config.EE_MAX_EVENTS; i--)
    {
@@ -1014,6 +1015,42 @@ TEST(CBUS, testFLiM_Events)
    canRxFrame = {.len=7, .data{OPC_ACOF3, othNNHi, othNNLo, 5, 5, 5, 5}};
    mockAddRxFrame(canRxFrame);
    cbus.process();
+
+   // Event variable handler, fed from the RAM mirror of event variables
+   static uint16_t evsIndex;
+   static bool evsOn;
+   static uint8_t evsValue;
+   static uint8_t evsNum;
+
+   cbus.setEventHandlerCB(nullptr);
+   cbus.setEventHandlerExCB(nullptr);
+   cbus.setEventHandlerEVsCB([](uint16_t index, const CANFrame &, bool ison, const uint8_t *evs, uint8_t numEVs)
+   {
+      evsIndex = index;
+      evsOn = ison;
+      evsNum = numEVs;
+      evsValue = (numEVs > 0) ? evs[0] : 0;
+   });
+
+   ASSERT_TRUE(config.setEVMirror(4)); // limited to EE_NUM_EVS
+   ASSERT_EQ(config.getEVMirror(), config.EE_NUM_EVS);
+
+   canRxFrame = {.len=5, .data{OPC_ACON, othNNHi, othNNLo, 2, 2}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+
+   ASSERT_EQ(evsIndex, 2);
+   ASSERT_TRUE(evsOn);
+   ASSERT_EQ(evsNum, 1);
+   ASSERT_EQ(evsValue, 3);
+
+   canRxFrame = {.len=5, .data{OPC_ACOF, othNNHi, othNNLo, 7, 7}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+
+   ASSERT_EQ(evsIndex, 7);
+   ASSERT_FALSE(evsOn);
+   ASSERT_EQ(evsValue, 8);
 }
 
 //-----------------------------------------------------------------------------
@@ -1881,6 +1918,1024 @@ TEST(CBUS, testFLiM_ModuleSetup)
    cbus.process();
 }
 
+//-----------------------------------------------------------------------------
+
+TEST(CBUS, processBurst)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Hook get message into mock CAN transport
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+
+   // Hook frame available API into mock CAN transport
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Queue more QNN requests than a single run will process
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   for (auto i=0; i < 5; i++)
+   {
+      mockAddRxFrame(canRxFrame);
+   }
+
+   // Default run processes three frames
+   cbus.process();
+
+   for (auto i=0; i < 3; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+
+   // Next run processes the remaining frames
+   cbus.process();
+
+   for (auto i=0; i < 2; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+
+   // Larger runs are drained in bursts
+   for (auto i=0; i < PROCESS_BURST_LEN + 2; i++)
+   {
+      mockAddRxFrame(canRxFrame);
+   }
+
+   cbus.process(PROCESS_BURST_LEN + 2);
+
+   for (auto i=0; i < PROCESS_BURST_LEN + 2; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+   ASSERT_FALSE(mockCanRxAvailable());
+}
+
+TEST(CBUS, opcodeTable)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Hook get message into mock CAN transport
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+
+   // Hook frame available API into mock CAN transport
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Module specific opcode table, extends the default table
+   static uint8_t bootCount;
+   bootCount = 0;
+
+   static opcodeTable_t table = CBUSbase::getDefaultOpcodeTable();
+   table[OPC_BOOT] = {OPC_FLAG_NN, [](CBUSbase &, CANFrame &) { bootCount++; }};
+   table[OPC_QNN] = {0, nullptr};
+
+   cbus.setOpcodeTable(table);
+
+   // Addressed to us, handled by the module entry
+   canRxFrame = {.len=3, .data{OPC_BOOT, ourNNHi, ourNNLo}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+   ASSERT_EQ(bootCount, 1);
+
+   // Addressed to another node, ignored
+   canRxFrame = {.len=3, .data{OPC_BOOT, 0x00, 0x01}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+   ASSERT_EQ(bootCount, 1);
+
+   // Entry removed, no response
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+
+   // Restore default table, QNN is answered
+   cbus.setOpcodeTable(CBUSbase::getDefaultOpcodeTable());
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+   ASSERT_TRUE(mockGetCanTx(canTxFrame));
+   ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+}
+
+TEST(CBUS, frameHandlers)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Hook get message into mock CAN transport
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+
+   // Hook frame available API into mock CAN transport
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Two handlers with their own opcode subscriptions
+   static uint8_t accCount;
+   static uint8_t qnnCount;
+   accCount = 0;
+   qnnCount = 0;
+
+   const uint8_t accOpcodes[] = {OPC_ACON, OPC_ACOF};
+   const uint8_t qnnOpcodes[] = {OPC_QNN};
+
+   auto accHandler = [](CANFrame &) { accCount++; };
+   auto qnnHandler = [](CANFrame &) { qnnCount++; };
+
+   ASSERT_TRUE(cbus.addFrameHandler(accHandler, CBUSbase::makeOpcodeMask(accOpcodes, sizeof(accOpcodes))));
+   ASSERT_TRUE(cbus.addFrameHandler(qnnHandler, CBUSbase::makeOpcodeMask(qnnOpcodes, sizeof(qnnOpcodes))));
+   ASSERT_TRUE(cbus.addFrameHandler(qnnHandler, CBUSbase::makeOpcodeMask(nullptr, 0)));
+   ASSERT_TRUE(cbus.addFrameHandler(qnnHandler, opcodeMask_t{}));
+
+   // Table is full
+   ASSERT_FALSE(cbus.addFrameHandler(qnnHandler, opcodeMask_t{}));
+
+   // Remove all registrations of one handler
+   ASSERT_TRUE(cbus.removeFrameHandler(qnnHandler));
+   ASSERT_FALSE(cbus.removeFrameHandler(qnnHandler));
+   ASSERT_TRUE(cbus.addFrameHandler(qnnHandler, CBUSbase::makeOpcodeMask(qnnOpcodes, sizeof(qnnOpcodes))));
+
+   canRxFrame = {.len=5, .data{OPC_ACON, 0x00, 0x01, 0x00, 0x01}};
+   mockAddRxFrame(canRxFrame);
+   canRxFrame = {.len=5, .data{OPC_ACOF, 0x00, 0x01, 0x00, 0x01}};
+   mockAddRxFrame(canRxFrame);
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   mockAddRxFrame(canRxFrame);
+   canRxFrame = {.len=5, .data{OPC_ASON, 0x00, 0x01, 0x00, 0x01}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process(4);
+
+   ASSERT_EQ(accCount, 2);
+   ASSERT_EQ(qnnCount, 1);
+
+   // Setting a single handler replaces all registrations
+   cbus.setFrameHandler(qnnHandler, const_cast<uint8_t *>(qnnOpcodes), sizeof(qnnOpcodes));
+
+   canRxFrame = {.len=5, .data{OPC_ACON, 0x00, 0x01, 0x00, 0x01}};
+   mockAddRxFrame(canRxFrame);
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+
+   ASSERT_EQ(accCount, 2);
+   ASSERT_EQ(qnnCount, 2);
+
+   // Removing the handler stops further calls
+   cbus.setFrameHandler(nullptr);
+   mockAddRxFrame(canRxFrame);
+   cbus.process();
+
+   ASSERT_EQ(qnnCount, 2);
+}
+
+TEST(CBUS, processBudget)
+{
+   static uint64_t sysTime;
+   sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        []() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Hook get message into mock CAN transport
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+
+   // Hook frame available API into mock CAN transport
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Each frame takes 1ms to process
+   const uint8_t qnnOpcodes[] = {OPC_QNN};
+   cbus.addFrameHandler([](CANFrame &) { sysTime++; }, CBUSbase::makeOpcodeMask(qnnOpcodes, sizeof(qnnOpcodes)));
+
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   for (auto i=0; i < 20; i++)
+   {
+      mockAddRxFrame(canRxFrame);
+   }
+
+   // Budget of 2.5ms, processing stops after the frame that exhausts it
+   cbus.setProcessBudget(2500);
+   ASSERT_EQ(cbus.getProcessBudget(), 2500);
+   cbus.process(20);
+
+   for (auto i=0; i < 3; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+   ASSERT_EQ(cbus.getNumBudgetExpiries(), 1);
+
+   // With the frame cost known, a burst is sized to the budget
+   cbus.setProcessBudget(4000);
+   cbus.process(20);
+
+   for (auto i=0; i < 4; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+   ASSERT_EQ(cbus.getNumBudgetExpiries(), 2);
+
+   // Without a budget the message count limits processing
+   cbus.setProcessBudget(0);
+   cbus.process(20);
+
+   for (auto i=0; i < 13; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+   ASSERT_FALSE(mockCanRxAvailable());
+   ASSERT_EQ(cbus.getNumBudgetExpiries(), 2);
+}
+
+TEST(CBUS, processAdaptiveBatch)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSQueueMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Frames are received through the mock's queue
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke([&cbus]() { return cbus.m_queue.available(); }));
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Fill the receive queue beyond half its capacity
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   for (auto i=0; i < 12; i++)
+   {
+      cbus.m_queue.put(canRxFrame);
+   }
+
+   // Fixed batch size by default
+   cbus.process();
+   ASSERT_EQ(cbus.m_queue.size(), 9);
+
+   // Queue depth exceeds the free slots, batch extended to drain it
+   cbus.setAdaptiveBatch(true);
+   cbus.process();
+   ASSERT_EQ(cbus.m_queue.size(), 0);
+
+   // Lightly loaded queue uses the requested batch size
+   for (auto i=0; i < 5; i++)
+   {
+      cbus.m_queue.put(canRxFrame);
+   }
+
+   cbus.process();
+   ASSERT_EQ(cbus.m_queue.size(), 2);
+
+   // New high water mark since the previous run, batch extended
+   for (auto i=0; i < 11; i++)
+   {
+      cbus.m_queue.put(canRxFrame);
+   }
+
+   cbus.process();
+   ASSERT_EQ(cbus.m_queue.size(), 0);
+
+   for (auto i=0; i < 28; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+}
+
+TEST(CBUS, processSourceScheduling)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Saturated CAN bus, frames from node 1
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(Return(CANFrame{.len=5, .data{OPC_ACON, 0x00, 0x01, 0x00, 0x01}}));
+
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(Return(true));
+
+   // Saturated GridConnect client, frames from node 2
+   CBUSGridConnect gcServer;
+
+   EXPECT_CALL(gcServer, available)
+      .WillRepeatedly(Return(true));
+   EXPECT_CALL(gcServer, get)
+      .WillRepeatedly(Return(CANFrame{.len=5, .data{OPC_ACON, 0x00, 0x02, 0x00, 0x01}}));
+   EXPECT_CALL(gcServer, canSend)
+      .WillRepeatedly(Return(true));
+   EXPECT_CALL(gcServer, sendCANFrame(_,_))
+      .Times(AnyNumber());
+
+   cbus.setGridConnectServer(&gcServer);
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Count frames received from each source
+   static uint8_t sourceCount[3];
+   memset(sourceCount, 0, sizeof(sourceCount));
+
+   const uint8_t accOpcodes[] = {OPC_ACON};
+   cbus.addFrameHandler([](CANFrame &msg) { sourceCount[msg.data[2]]++; }, CBUSbase::makeOpcodeMask(accOpcodes, sizeof(accOpcodes)));
+
+   ASSERT_EQ(cbus.getSourceWeight(RX_SOURCE::RX_SOURCE_CAN), RX_SOURCE_DEFAULT_WEIGHT);
+
+   // Weight CAN three times GridConnect
+   cbus.setSourceWeight(RX_SOURCE::RX_SOURCE_GC, 1);
+   cbus.setSourceWeight(RX_SOURCE::RX_SOURCE_CAN, 3);
+
+   cbus.process(8);
+   ASSERT_EQ(sourceCount[1], 6);
+   ASSERT_EQ(sourceCount[2], 2);
+
+   // Both sources were served
+   ASSERT_EQ(cbus.getNumStarvations(RX_SOURCE::RX_SOURCE_GC), 0);
+   ASSERT_EQ(cbus.getNumStarvations(RX_SOURCE::RX_SOURCE_CAN), 0);
+   ASSERT_EQ(cbus.getNumStarvations(RX_SOURCE::RX_SOURCE_COE), 0);
+
+   // Heavily weighted GridConnect holds off CAN for a bounded number of runs
+   cbus.setSourceWeight(RX_SOURCE::RX_SOURCE_GC, 8);
+   memset(sourceCount, 0, sizeof(sourceCount));
+
+   cbus.process(3);
+   cbus.process(3);
+   ASSERT_EQ(sourceCount[1], 0);
+   ASSERT_EQ(sourceCount[2], 6);
+   ASSERT_EQ(cbus.getNumStarvations(RX_SOURCE::RX_SOURCE_CAN), 2);
+
+   cbus.process(3);
+   ASSERT_EQ(sourceCount[1], 1);
+   ASSERT_EQ(sourceCount[2], 8);
+   ASSERT_EQ(cbus.getNumStarvations(RX_SOURCE::RX_SOURCE_CAN), 2);
+   ASSERT_EQ(cbus.getNumStarvations(RX_SOURCE::RX_SOURCE_GC), 0);
+
+   // A weight of zero still allows a frame per round
+   cbus.setSourceWeight(RX_SOURCE::RX_SOURCE_CAN, 0);
+   ASSERT_EQ(cbus.getSourceWeight(RX_SOURCE::RX_SOURCE_CAN), 1);
+
+   // Lowering the weight of a source part way through its round restarts the round
+   cbus.setSourceWeight(RX_SOURCE::RX_SOURCE_GC, 8);
+   cbus.process(1);
+   cbus.process(4);
+   memset(sourceCount, 0, sizeof(sourceCount));
+
+   cbus.setSourceWeight(RX_SOURCE::RX_SOURCE_GC, 2);
+   cbus.process(4);
+   ASSERT_EQ(sourceCount[1], 1);
+   ASSERT_EQ(sourceCount[2], 3);
+
+   cbus.setGridConnectServer(nullptr);
+}
+
+TEST(CBUS, eventDriven)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Hook get message into mock CAN transport
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+
+   // Hook frame available API into mock CAN transport
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+
+   // Hook frame transmit capture into mock CAN transport
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(&mockCanTx));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // No transmissions deferred by a rate limit
+   EXPECT_CALL(cbus, txPending(_))
+      .WillRepeatedly(Return(false));
+
+   // Polled by default, work is always pending
+   ASSERT_TRUE(cbus.workPending());
+
+   // Event driven, housekeeping last ran at time zero
+   cbus.setEventDriven(true, 10);
+   ASSERT_FALSE(cbus.workPending());
+
+   // Sleep until the housekeeping interval is due, woken at the timeout
+   EXPECT_CALL(mockPicoSdk, best_effort_wfe_or_timeout(10000))
+      .WillOnce(testing::Invoke(
+         [&sysTime](absolute_time_t) -> bool {
+            sysTime += 10;
+            return true;
+         }
+   ));
+   cbus.waitForWork();
+   ASSERT_TRUE(cbus.workPending());
+
+   // Housekeeping runs, nothing else to do
+   cbus.process();
+   ASSERT_FALSE(cbus.workPending());
+
+   // Wait limited by the caller
+   sysTime += 2;
+   EXPECT_CALL(mockPicoSdk, best_effort_wfe_or_timeout((sysTime + 5) * 1000))
+      .WillOnce(Return(true));
+   cbus.waitForWork(5);
+
+   // A frame deferred by a transmit rate limit shortens the sleep to when its token is due
+   EXPECT_CALL(cbus, txPending(_))
+      .WillOnce(testing::DoAll(testing::SetArgReferee<0>(2500), Return(true)))
+      .WillRepeatedly(Return(false));
+   EXPECT_CALL(mockPicoSdk, best_effort_wfe_or_timeout((sysTime * 1000) + 2500))
+      .WillOnce(Return(true));
+   cbus.waitForWork();
+
+   // A deferred frame due later than the housekeeping interval does not extend the sleep
+   EXPECT_CALL(cbus, txPending(_))
+      .WillOnce(testing::DoAll(testing::SetArgReferee<0>(50000), Return(true)))
+      .WillRepeatedly(Return(false));
+   EXPECT_CALL(mockPicoSdk, best_effort_wfe_or_timeout((sysTime + 8) * 1000))
+      .WillOnce(Return(true));
+   cbus.waitForWork();
+
+   // Housekeeping falling due after the pending work check does not wrap the sleep
+   EXPECT_CALL(cbus, available)
+      .WillOnce(testing::Invoke(
+         [&sysTime]() -> bool {
+            sysTime += 20;
+            return false;
+         }
+      ))
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+   EXPECT_CALL(mockPicoSdk, best_effort_wfe_or_timeout((sysTime + 20) * 1000))
+      .WillOnce(Return(true));
+   cbus.waitForWork();
+   ASSERT_TRUE(cbus.workPending());
+   cbus.process();
+
+   // A housekeeping interval beyond the longest sleep is limited, not wrapped
+   cbus.setEventDriven(true, 5000000);
+   EXPECT_CALL(mockPicoSdk, best_effort_wfe_or_timeout((sysTime * 1000) + UINT32_MAX))
+      .WillOnce(Return(true));
+   cbus.waitForWork();
+   cbus.setEventDriven(true, 10);
+
+   // Wakeup signalled from an interrupt handler
+   CBUSbase::signalWakeup();
+   ASSERT_TRUE(cbus.workPending());
+   cbus.waitForWork();
+   cbus.process();
+   ASSERT_FALSE(cbus.workPending());
+
+   // A received frame is pending work, and is processed between housekeeping runs
+   canRxFrame = {.len=1, .data{OPC_QNN}};
+   mockAddRxFrame(canRxFrame);
+   ASSERT_TRUE(cbus.workPending());
+   cbus.waitForWork();
+   cbus.process();
+
+   ASSERT_TRUE(mockGetCanTx(canTxFrame));
+   ASSERT_EQ(canTxFrame.data[0], OPC_PNN);
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+   ASSERT_FALSE(cbus.workPending());
+
+   // Back to polled operation
+   cbus.setEventDriven(false);
+   ASSERT_TRUE(cbus.workPending());
+}
+
+TEST(CBUS, sendEvents)
+{
+   uint64_t sysTime = 0ULL;
+
+   MockPicoSdk mockPicoSdk;
+   mockPicoSdkApi.mockPicoSdk = &mockPicoSdk;
+
+   // Clear mock transport
+   clearRxFrames();
+   clearTxFrames();
+
+   EXPECT_CALL(mockPicoSdk, flash_range_program(_,_,_)).Times(AnyNumber());
+   EXPECT_CALL(mockPicoSdk, flash_range_erase(0, FLASH_SECTOR_SIZE)).Times(AnyNumber());
+
+   dummyFlashInit();
+
+   // Manage system time via lambda
+   EXPECT_CALL(mockPicoSdk, get_absolute_time)
+       .WillRepeatedly(testing::Invoke(
+        [&sysTime]() -> uint64_t {
+            return sysTime * 1000; // time specified in milliseconds
+        }
+    ));
+
+   // Configuration
+   CBUSConfig config;
+   config.EE_NVS_START = 10;    // Offset start of Node Variables
+   config.EE_NUM_NVS = 10;      // Number of Node Variables
+   config.EE_EVENTS_START = 20; // Offset start of Events
+   config.EE_MAX_EVENTS = 10;   // Maximum number of events
+   config.EE_NUM_EVS = 1;       // Number of Event Variables per event (the InEventID)
+   config.EE_BYTES_PER_EVENT = (config.EE_NUM_EVS + 4);
+
+   config.setEEPROMtype(EEPROM_TYPE::EEPROM_USES_FLASH);
+
+   // Force persistent storage to indicate FLiM mode
+   uint8_t flimConfig[] = {0x1, 0x00, ourNNHi, ourNNLo, 0x00, 0x00};
+   memcpy(dummyFlash, flimConfig, sizeof(flimConfig));
+
+   // Initialize from storage
+   config.begin();
+
+   // Create UUT - with mocked I/O interfaces, initiate FLiM
+   CBUSMock cbus(config);
+
+   // Setup as FLiM
+   cbus.indicateFLiMMode(true);
+
+   // CAN Frames for sending and receiving
+   CANFrame canRxFrame;
+   CANFrame canTxFrame;
+
+   // Hook get message into mock CAN transport
+   EXPECT_CALL(cbus, getNextMessage)
+      .WillRepeatedly(testing::Invoke(&mockCanRx));
+
+   // Hook frame available API into mock CAN transport
+   EXPECT_CALL(cbus, available)
+      .WillRepeatedly(testing::Invoke(&mockCanRxAvailable));
+
+   // Hook frame transmit capture into mock CAN transport
+   // Transmit accepts a limited number of frames, then refuses
+   static uint8_t txSpace;
+   txSpace = 3;
+
+   EXPECT_CALL(cbus, sendMessageImpl(_,false,false,_))
+      .WillRepeatedly(testing::Invoke(
+         [](CANFrame &msg, bool rtr, bool ext, uint8_t priority) -> bool {
+            // Write the header into the frame, as a CAN driver does
+            msg.id = (priority << 7) + (msg.id & 0x7f);
+
+            if (txSpace == 0)
+            {
+               return false;
+            }
+            txSpace--;
+            return mockCanTx(msg, rtr, ext, priority);
+         }
+   ));
+
+   CBUSParams params(config);
+   cbus.setParams(params.getParams());
+
+   // Consume our own events
+   CBUScoe coe(10);
+   cbus.consumeOwnEvents(&coe);
+
+   static uint8_t numCallbacks;
+   static uint16_t numCompleted;
+   numCallbacks = 0;
+   numCompleted = 0;
+
+   const EVENT_SEND_t events[] = {
+      {.nodeNumber=0x0102, .eventNumber=1, .onEvent=true, .dataLen=0, .data{}},
+      {.nodeNumber=0x0102, .eventNumber=2, .onEvent=false, .dataLen=0, .data{}},
+      {.nodeNumber=0, .eventNumber=3, .onEvent=true, .dataLen=0, .data{}},
+      {.nodeNumber=0x0102, .eventNumber=4, .onEvent=true, .dataLen=2, .data{0xAA, 0xBB, 0x00}},
+      {.nodeNumber=0x0102, .eventNumber=5, .onEvent=false, .dataLen=0, .data{}},
+   };
+   const uint8_t opcodes[] = {OPC_ACON, OPC_ACOF, OPC_ASON, OPC_ACON2, OPC_ACOF};
+
+   ASSERT_TRUE(cbus.sendEvents(events, 5, [](const EVENT_SEND_t *, uint16_t numEvents) {
+      numCallbacks++;
+      numCompleted = numEvents;
+   }));
+
+   // Transmit space for the first three, which are also posted to our own queue
+   ASSERT_TRUE(cbus.eventBatchActive());
+   ASSERT_EQ(numCallbacks, 0);
+
+   // Own events are posted without the header written by the transmit path
+   CANFrame coeFrame;
+   for (uint8_t i=0; i < 3; i++)
+   {
+      ASSERT_EQ(coe.getMessages(&coeFrame, 1), 1);
+      ASSERT_EQ(coeFrame.data[0], opcodes[i]);
+      ASSERT_EQ(coeFrame.id, config.getCANID());
+   }
+   ASSERT_FALSE(coe.available());
+
+   // Short event carries our node number
+   ASSERT_EQ(coeFrame.data[1], ourNNHi);
+   ASSERT_EQ(coeFrame.data[2], ourNNLo);
+
+   // A second batch is refused whilst the first is in progress
+   ASSERT_FALSE(cbus.sendEvents(events, 5));
+
+   // No space, no progress
+   cbus.process();
+   ASSERT_TRUE(cbus.eventBatchActive());
+
+   // Space frees up, the batch completes
+   txSpace = 10;
+   cbus.process();
+   ASSERT_FALSE(cbus.eventBatchActive());
+   ASSERT_EQ(numCallbacks, 1);
+   ASSERT_EQ(numCompleted, 5);
+
+   // Events sent in order, own events consumed once each
+   for (uint8_t i=0; i < 5; i++)
+   {
+      ASSERT_TRUE(mockGetCanTx(canTxFrame));
+      ASSERT_EQ(canTxFrame.data[0], opcodes[i]);
+      ASSERT_EQ(canTxFrame.data[4], i + 1);
+   }
+   ASSERT_FALSE(mockGetCanTx(canTxFrame));
+
+   // Remaining own events queued once each
+   for (uint8_t i=3; i < 5; i++)
+   {
+      ASSERT_EQ(coe.getMessages(&coeFrame, 1), 1);
+      ASSERT_EQ(coeFrame.data[0], opcodes[i]);
+      ASSERT_EQ(coeFrame.id, config.getCANID());
+   }
+   ASSERT_FALSE(coe.available());
+
+   cbus.consumeOwnEvents(nullptr);
+}
+
 // Long / short events()
 
 // Consume own events
@@ -0,0 +1,21 @@
+// FAKE STUB HEADER
+
+#pragma once
+
+#include <cstdint>
+
+typedef enum
+{
+   PIO0_IRQ_0_IRQn = 7,
+   PIO1_IRQ_0_IRQn = 9
+} IRQn_Type;
+
+static uint32_t SystemCoreClock {125000000UL};
+
+static inline void NVIC_SetPriority(IRQn_Type, uint32_t)
+{
+}
+
+static inline void NVIC_EnableIRQ(IRQn_Type)
+{
+}
@@ -0,0 +1,58 @@
+/*
+Based on mocklib from the SmartFilamentSensor distribution
+Copyright (c) 2023 Slava Zanko
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mocklib.h"
+
+extern "C"
+{
+#include "can2040.h"
+
+void can2040_setup(struct can2040 *cd, uint32_t pio_num)
+{
+}
+
+void can2040_callback_config(struct can2040 *cd, can2040_rx_cb rx_cb)
+{
+}
+
+void can2040_start(struct can2040 *cd, uint32_t sys_clock, uint32_t bitrate, uint32_t gpio_rx, uint32_t gpio_tx)
+{
+}
+
+void can2040_stop(struct can2040 *cd)
+{
+}
+
+void can2040_get_statistics(struct can2040 *cd, struct can2040_stats *stats)
+{
+}
+
+void can2040_pio_irq_handler(struct can2040 *cd)
+{
+}
+
+int can2040_check_transmit(struct can2040 *cd)
+{
+    return mockPicoSdkApi.mockPicoSdk->can2040_check_transmit(cd);
+}
+
+int can2040_transmit(struct can2040 *cd, struct can2040_msg *msg)
+{
+    return mockPicoSdkApi.mockPicoSdk->can2040_transmit(cd, msg);
+}
+}
@@ -0,0 +1,45 @@
+// FAKE STUB HEADER
+
+#pragma once
+
+#include <stdint.h>
+
+struct can2040_msg
+{
+   uint32_t id;
+   uint32_t dlc;
+   union
+   {
+      uint8_t data[8];
+      uint32_t data32[2];
+   };
+};
+
+struct can2040
+{
+};
+
+struct can2040_stats
+{
+   uint32_t rx_total, tx_total;
+   uint32_t tx_attempt;
+   uint32_t parse_error;
+};
+
+typedef void (*can2040_rx_cb)(struct can2040 *cd, uint32_t notify, struct can2040_msg *msg);
+
+#define CAN2040_ID_RTR (1UL << 30)
+#define CAN2040_ID_EFF (1UL << 31)
+
+#define CAN2040_NOTIFY_RX (1 << 20)
+#define CAN2040_NOTIFY_TX (1 << 21)
+#define CAN2040_NOTIFY_ERROR (1 << 23)
+
+void can2040_setup(struct can2040 *cd, uint32_t pio_num);
+void can2040_callback_config(struct can2040 *cd, can2040_rx_cb rx_cb);
+void can2040_start(struct can2040 *cd, uint32_t sys_clock, uint32_t bitrate, uint32_t gpio_rx, uint32_t gpio_tx);
+void can2040_stop(struct can2040 *cd);
+void can2040_get_statistics(struct can2040 *cd, struct can2040_stats *stats);
+void can2040_pio_irq_handler(struct can2040 *cd);
+int can2040_check_transmit(struct can2040 *cd);
+int can2040_transmit(struct can2040 *cd, struct can2040_msg *msg);
@@ -17,11 +17,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "mocklib.h"
 
-uint8_t dummyFlash[FLASH_SECTOR_SIZE] {0xFF};
+uint8_t dummyFlash[FLASH_SECTOR_SIZE * DUMMY_FLASH_SECTORS] {0xFF};
 
 void dummyFlashInit()
 {
-   memset(dummyFlash, 0xFF, FLASH_SECTOR_SIZE);
+   memset(dummyFlash, 0xFF, sizeof(dummyFlash));
 }
 
 void flash_range_erase (uint32_t flash_offs, size_t count)
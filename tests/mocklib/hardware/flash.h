@@ -5,14 +5,24 @@
 #include <cstdint>
 #include <cstdlib>
 
+#ifndef CBUS_FLASH_SECTORS
+#define CBUS_FLASH_SECTORS 1
+#endif
+
 static constexpr const uint16_t FLASH_SECTOR_SIZE {1u << 12};
 
-// Provide faked single sector of flash that can be read/written
-extern uint8_t dummyFlash[FLASH_SECTOR_SIZE];
+// Number of sectors of faked flash, enough for the largest CBUS_FLASH_SECTORS under test
+static constexpr const uint32_t DUMMY_FLASH_SECTORS {2};
+
+static_assert(CBUS_FLASH_SECTORS <= DUMMY_FLASH_SECTORS, "CBUS_FLASH_SECTORS exceeds the faked flash");
+
+// Provide faked sectors of flash that can be read/written
+extern uint8_t dummyFlash[FLASH_SECTOR_SIZE * DUMMY_FLASH_SECTORS];
 
 static const uintptr_t XIP_BASE = reinterpret_cast<uintptr_t>(&dummyFlash[0]);
 
-static constexpr const auto PICO_FLASH_SIZE_BYTES {FLASH_SECTOR_SIZE};
+// Flash ends with the CBUS storage, so the storage always starts at dummyFlash[0]
+static constexpr const uint32_t PICO_FLASH_SIZE_BYTES {FLASH_SECTOR_SIZE * CBUS_FLASH_SECTORS};
 
 void flash_range_erase (uint32_t flash_offs, size_t count);
 
@@ -0,0 +1,9 @@
+// FAKE STUB HEADER
+
+#pragma once
+
+typedef void (*irq_handler_t)(void);
+
+static inline void irq_set_exclusive_handler(unsigned int, irq_handler_t)
+{
+}
@@ -0,0 +1,3 @@
+// FAKE STUB HEADER
+
+#pragma once
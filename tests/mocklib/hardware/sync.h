@@ -4,12 +4,16 @@
 
 #include <cstdint>
 
-uint64_t make_timeout_time_ms(uint64_t)
+static inline uint64_t make_timeout_time_ms(uint64_t)
 {
    return 0;
 }
 
-void busy_wait_ms (uint32_t delay_ms)
+static inline void busy_wait_ms (uint32_t delay_ms)
+{
+}
+
+static inline void __sev (void)
 {
 }
 
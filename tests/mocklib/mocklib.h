@@ -29,6 +29,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hardware/i2c.h"
 #include "pico/time.h"
 
+extern "C"
+{
+#include "can2040.h"
+}
+
 class PicoSdkInterface
 {
 public:
@@ -38,6 +43,7 @@ public:
     // time functions
     virtual absolute_time_t get_absolute_time() = 0;
     virtual int64_t absolute_time_diff_us(absolute_time_t, absolute_time_t) = 0;
+    virtual bool best_effort_wfe_or_timeout(absolute_time_t) = 0;
 
     // PIO functions
     virtual pio_sm_config pio_get_default_sm_config() = 0;
@@ -73,6 +79,10 @@ public:
     // flash functions
     virtual void flash_range_erase (uint32_t, size_t) = 0;
     virtual void flash_range_program (uint32_t, const uint8_t *data, size_t) = 0;
+
+    // can2040 functions
+    virtual int can2040_check_transmit(struct can2040 *) = 0;
+    virtual int can2040_transmit(struct can2040 *, struct can2040_msg *) = 0;
 };
 
 class MockPicoSdk : public PicoSdkInterface
@@ -82,6 +92,7 @@ public:
 
     MOCK_METHOD(absolute_time_t, get_absolute_time, (), (override));
     MOCK_METHOD(int64_t, absolute_time_diff_us, (absolute_time_t, absolute_time_t), (override));
+    MOCK_METHOD(bool, best_effort_wfe_or_timeout, (absolute_time_t), (override));
 
     MOCK_METHOD(pio_sm_config, pio_get_default_sm_config, (), (override));
     MOCK_METHOD(void, sm_config_set_wrap, (pio_sm_config *, uint, uint), (override));
@@ -113,6 +124,9 @@ public:
 
     MOCK_METHOD(void, flash_range_erase, (uint32_t, size_t), (override));
     MOCK_METHOD(void, flash_range_program, (uint32_t, const uint8_t *data, size_t), (override));
+
+    MOCK_METHOD(int, can2040_check_transmit, (struct can2040 *), (override));
+    MOCK_METHOD(int, can2040_transmit, (struct can2040 *, struct can2040_msg *), (override));
 };
 
 class MockPicoSdkApi
@@ -1 +1,19 @@
-// FAKE STUB HEADER
\ No newline at end of file
+// FAKE STUB HEADER
+
+#pragma once
+
+static inline void multicore_launch_core1(void (*entry)(void))
+{
+}
+
+static inline void multicore_lockout_victim_init(void)
+{
+}
+
+static inline void multicore_lockout_start_blocking(void)
+{
+}
+
+static inline void multicore_lockout_end_blocking(void)
+{
+}
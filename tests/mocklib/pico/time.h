@@ -44,4 +44,8 @@ absolute_time_t get_absolute_time(void);
 
 int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
 
+absolute_time_t make_timeout_time_us(uint64_t us);
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp);
+
 #endif
@@ -27,4 +27,14 @@ absolute_time_t get_absolute_time(void)
 int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
 {
     return mockPicoSdkApi.mockPicoSdk->absolute_time_diff_us(from, to);
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us)
+{
+    return get_absolute_time() + us;
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp)
+{
+    return mockPicoSdkApi.mockPicoSdk->best_effort_wfe_or_timeout(timeout_timestamp);
 }
\ No newline at end of file
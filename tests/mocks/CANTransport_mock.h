@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <queue>
+
+#include <CBUSCircularBuffer.h>
+
+//-----------------------------------------------------------------------------
+// Mock CAN transport, saves all frames posted for transmission to a queue
+
+inline std::queue<CANFrame> canRxFrames;  // Frames received off the wire into CBUS
+inline std::queue<CANFrame> canTxFrames;  // Frames generated by CBUS to be sent to the wire
+
+// Add a frame to the mock to be processed by CBUS
+inline void mockAddRxFrame(CANFrame& frame)
+{
+   canRxFrames.push(frame);
+}
+
+// Are there any frames to be received off the wire
+inline bool mockCanRxAvailable(void)
+{
+   return !canRxFrames.empty();
+}
+
+// Retrieve the next frame off the wire to be processed by CBUS
+inline CANFrame mockCanRx(void)
+{
+   if (canRxFrames.size() > 0)
+   {
+      CANFrame frame = canRxFrames.front();
+      canRxFrames.pop();
+      return frame;
+   }
+   else
+   { 
+      // THIS SHOULD REALY BE AN ASSERT!
+      CANFrame frame;
+      return frame;
+   }
+}
+
+inline void clearRxFrames(void)
+{
+   while (!canRxFrames.empty())
+   {
+      canRxFrames.pop();
+   }
+}
+
+// Test for frames and retrieve first frame sent by CBUS
+inline bool mockGetCanTx(CANFrame& msg)
+{
+   // Are there any frames transmitted?
+   if (!canTxFrames.empty())
+   {
+      // Retreive first frame queued
+      msg = canTxFrames.front();
+      canTxFrames.pop();
+      return true;
+   }
+
+   // No frames available
+   return false;
+}
+
+// Capture frames transmitted by CBUS (send to the wire)
+inline bool canTxReturn {true};
+inline bool mockCanTx(CANFrame &msg, bool rtr, bool ext, uint8_t /* priority */)
+{
+   msg.rtr = rtr;
+   msg.ext = ext;
+
+   // Only frames accepted for transmission are captured
+   if (canTxReturn)
+   {
+      canTxFrames.push(msg);
+   }
+
+   return canTxReturn;
+}
+
+inline void clearTxFrames(void)
+{
+   while (!canTxFrames.empty())
+   {
+      canTxFrames.pop();
+   }
+}
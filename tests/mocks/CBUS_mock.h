@@ -12,6 +12,7 @@ public:
    MOCK_METHOD(CANFrame, getNextMessage,(), (override));
    MOCK_METHOD(bool, sendMessageImpl, (CANFrame &msg, bool rtr, bool ext, uint8_t priority));
    MOCK_METHOD(void, reset, (), (override));
+   MOCK_METHOD(bool, txPending, (uint32_t &wait_us), (override));
 
    MOCK_METHOD(bool, validateNV, (const uint8_t NVindex, const uint8_t oldValue, const uint8_t NVvalue), (override));
    MOCK_METHOD(void, actUponNVchange, (const uint8_t NVindex, const uint8_t oldValue, const uint8_t NVvalue), (override));